@@ -0,0 +1,80 @@
+# Creates the static asset table served by the web server. Files are
+# compressed with the best available method, js and css get the content hash
+# in the file name so they can be cached as immutable and index.html is
+# updated to use the new names. Runs as a pre script or standalone:
+#   python3 script/create_assets.py <output dir>
+import gzip, hashlib, os, sys
+
+assets = [
+    # file, url, content type, hashed name
+    ("ui/app.js.gz", "/js/app.js", "application/javascript", True),
+    ("ui/app.css.gz", "/css/app.css", "text/css", True),
+    ("ui/favicon.ico.gz", "/favicon.ico", "image/x-icon", False),
+    ("ui/index.html", "/index.html", "text/html", False),  # Must be last
+]
+
+def compress(raw, prebuilt):
+    candidates = [gzip.compress(raw, compresslevel=9, mtime=0)]
+
+    if prebuilt:
+        candidates.append(prebuilt)
+
+    try:
+        import zopfli.gzip
+        candidates.append(zopfli.gzip.compress(raw))
+    except ImportError:
+        pass
+
+    return min(candidates, key=len)
+
+def create_assets(project_dir, output_dir):
+    os.makedirs(output_dir, exist_ok=True)
+    table, renamed = [], {}
+
+    for file, url, type, hashed in assets:
+        content = open(os.path.join(project_dir, file), "rb").read()
+        prebuilt = None
+
+        if file.endswith(".gz"):
+            prebuilt, content = content, gzip.decompress(content)
+
+        for old, new in renamed.items():
+            updated = content.replace(('"%s"' % old).encode(), ('"%s"' % new).encode())
+            if updated != content:
+                content, prebuilt = updated, None
+
+        data = compress(content, prebuilt)
+        etag = hashlib.sha256(data).hexdigest()[:16]
+
+        if hashed:
+            base, ext = os.path.splitext(url)
+            renamed[url] = "%s.%s%s" % (base, etag[:8], ext)
+            url = renamed[url]
+
+        table.append((url, type, etag, data, hashed))
+        print("Asset %s, %d bytes (%d uncompressed), etag %s" % (url, len(data), len(content), etag))
+
+    table.sort(key=lambda a: a[0])
+
+    with open(os.path.join(output_dir, "assets_data.h"), "w") as f:
+        f.write("// Generated by script/create_assets.py, do not edit.\n")
+
+        for i, (url, type, etag, data, hashed) in enumerate(table):
+            lines = ["  " + ",".join("0x%02x" % b for b in data[j:j + 20]) + ","
+                     for j in range(0, len(data), 20)]
+            f.write("const uint8_t assetData%d[] PROGMEM = {\n%s\n};\n" % (i, "\n".join(lines)))
+
+        f.write("\n// Sorted by path\nconstexpr StaticAsset staticAssets[] = {\n")
+        for i, (url, type, etag, data, hashed) in enumerate(table):
+            f.write("    {\"%s\", \"%s\", \"\\\"%s\\\"\", assetData%d, %d, %s},\n" %
+                    (url, type, etag, i, len(data), "true" if hashed else "false"))
+        f.write("};\n")
+
+if __name__ == "__main__":
+    create_assets(os.getcwd(), sys.argv[1])
+else:
+    Import("env")
+    output = os.path.join(env.subst("$PROJECT_BUILD_DIR"), env.subst("$PIOENV"), "generated")
+    print("Creating static asset table in %s" % output)
+    create_assets(env.subst("$PROJECT_DIR"), output)
+    env.Append(CPPPATH=[output])
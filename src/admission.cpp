@@ -0,0 +1,186 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <admission.hpp>
+#include <log.hpp>
+#include <metrics.hpp>
+
+AdmissionControl myAdmission;
+
+constexpr WebRequestMethod jsonMethods[] = {HTTP_POST, HTTP_PUT, HTTP_PATCH};
+constexpr const char *jsonMethodNames[] = {"POST", "PUT", "PATCH"};
+
+// Returns false and sends 503 if the request is refused.
+bool AdmissionControl::admit(AsyncWebServerRequest *request, size_t size) {
+  if (!size) return true;
+
+  if (!tryAdmit(request, size)) {
+    refuse(request);
+    return false;
+  }
+
+  return true;
+}
+
+// Same as admit() but the caller sends the response when refused. Admitted
+// requests count as in flight until the client is disconnected, which is when
+// the response has been sent and freed.
+bool AdmissionControl::tryAdmit(AsyncWebServerRequest *request, size_t size) {
+  uint32_t block = getLargestFreeBlock();
+
+  if (_inflight >= ADMISSION_MAX_INFLIGHT ||
+      block < size + ADMISSION_HEAP_MARGIN) {
+    Log.warning(F("WEB : Refusing %s, in flight %d, free block %d." CR),
+                request->url().c_str(), _inflight, block);
+    return false;
+  }
+
+  _inflight++;
+  onDisconnect(request, [this]() { _inflight--; });
+  return true;
+}
+
+// The server keeps a single disconnect callback per request, so callbacks are
+// added here and chained. Use this instead of request->onDisconnect().
+void AdmissionControl::onDisconnect(AsyncWebServerRequest *request,
+                                    ArDisconnectHandler fn) {
+  _handlers = new DisconnectHandler{request, fn, _handlers};
+  request->onDisconnect([this, request]() { disconnected(request); });
+}
+
+// Runs the callbacks of the request in the order they were added
+void AdmissionControl::disconnected(AsyncWebServerRequest *request) {
+  DisconnectHandler *run = nullptr;
+
+  for (DisconnectHandler **p = &_handlers; *p;) {
+    DisconnectHandler *h = *p;
+
+    if (h->request == request) {
+      *p = h->next;
+      h->next = run;
+      run = h;
+    } else {
+      p = &h->next;
+    }
+  }
+
+  while (run) {
+    DisconnectHandler *h = run;
+    run = h->next;
+    h->fn();
+    delete h;
+  }
+}
+
+void AdmissionControl::refuse(AsyncWebServerRequest *request) {
+  AsyncWebServerResponse *response = request->beginResponse(
+      503, "application/json",
+      "{\"success\":false,\"message\":\"Device is busy, try again\"}");
+  response->addHeader("Retry-After", ADMISSION_RETRY_AFTER);
+  request->send(response);
+}
+
+AdmissionJsonHandler::AdmissionJsonHandler(
+    const char *uri, WebRequestMethodComposite method,
+    ArJsonRequestHandlerFunction onRequest, size_t maxJsonSize, size_t size)
+    : _uri(uri),
+      _method(method),
+      _onRequest(onRequest),
+      _maxJsonSize(maxJsonSize),
+      _size(size) {
+  for (size_t i = 0; i < sizeof(jsonMethods) / sizeof(jsonMethods[0]); i++) {
+    if (_method & jsonMethods[i])
+      _metrics[i] = myMetrics.add(uri, jsonMethodNames[i]);
+  }
+}
+
+RouteMetrics *AdmissionJsonHandler::getMetrics(
+    WebRequestMethodComposite method) {
+  for (size_t i = 0; i < sizeof(jsonMethods) / sizeof(jsonMethods[0]); i++) {
+    if (method == jsonMethods[i]) return _metrics[i];
+  }
+
+  return nullptr;
+}
+
+bool AdmissionJsonHandler::canHandle(AsyncWebServerRequest *request) {
+  if (!(_method & request->method())) return false;
+
+  if (_uri != request->url() && !request->url().startsWith(_uri + "/"))
+    return false;
+
+  if (!request->contentType().equalsIgnoreCase(JSON_MIMETYPE)) return false;
+
+  request->addInterestingHeader("ANY");
+  return true;
+}
+
+// The body is only buffered when the request is admitted, the buffer is freed
+// with the request.
+void AdmissionJsonHandler::handleBody(AsyncWebServerRequest *request,
+                                      uint8_t *data, size_t len, size_t index,
+                                      size_t total) {
+  if (index == 0 && total <= _maxJsonSize &&
+      myAdmission.tryAdmit(request, _size + _maxJsonSize + total))
+    request->_tempObject = malloc(total);
+
+  if (request->_tempObject)
+    memcpy(static_cast<uint8_t *>(request->_tempObject) + index, data, len);
+}
+
+void AdmissionJsonHandler::handleRequest(AsyncWebServerRequest *request) {
+  RouteMetrics *m = getMetrics(request->method());
+  size_t length = request->contentLength();
+
+  if (!length) {
+    request->send(400);
+    return;
+  }
+
+  if (length > _maxJsonSize) {
+    request->send(413);
+    return;
+  }
+
+  if (!request->_tempObject) {  // Refused or out of memory
+    myAdmission.refuse(request);
+    myMetrics.reject(m);
+    return;
+  }
+
+  RequestSample sample = myMetrics.begin();
+  DynamicJsonDocument doc(_maxJsonSize);
+  DeserializationError err = deserializeJson(
+      doc, static_cast<const char *>(request->_tempObject), length);
+
+  if (err) {
+    request->send(400);
+    return;
+  }
+
+  JsonVariant json = doc.as<JsonVariant>();
+  _onRequest(request, json);
+  myMetrics.end(m, sample);
+}
+
+// EOF
@@ -0,0 +1,92 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_ADMISSION_HPP_
+#define SRC_ADMISSION_HPP_
+
+#include <AsyncJson.h>
+#include <ESPAsyncWebServer.h>
+#include <metrics.hpp>
+
+#if defined(ESP8266)
+constexpr auto ADMISSION_MAX_INFLIGHT = 2;
+#else
+constexpr auto ADMISSION_MAX_INFLIGHT = 4;
+#endif
+constexpr auto ADMISSION_HEAP_MARGIN = 4096;  // Left for wifi and tcp buffers
+constexpr auto ADMISSION_RETRY_AFTER = "2";   // Seconds
+
+// Refuses requests that need a large json document when the heap can not fit
+// it or too many large responses are already being sent.
+class AdmissionControl {
+ private:
+  struct DisconnectHandler {
+    AsyncWebServerRequest *request;
+    ArDisconnectHandler fn;
+    DisconnectHandler *next;
+  };
+
+  volatile int _inflight = 0;
+  DisconnectHandler *_handlers = nullptr;
+
+  void disconnected(AsyncWebServerRequest *request);
+
+ public:
+  bool admit(AsyncWebServerRequest *request, size_t size);
+  bool tryAdmit(AsyncWebServerRequest *request, size_t size);
+  void refuse(AsyncWebServerRequest *request);
+  void onDisconnect(AsyncWebServerRequest *request, ArDisconnectHandler fn);
+  int getInflight() { return _inflight; }
+};
+
+// Replaces AsyncCallbackJsonWebHandler for the api. Admission is checked when
+// the body starts to arrive, so a refused request is never buffered or parsed.
+// Latency is recorded per method.
+class AdmissionJsonHandler : public AsyncWebHandler {
+ private:
+  String _uri;
+  WebRequestMethodComposite _method;
+  ArJsonRequestHandlerFunction _onRequest;
+  size_t _maxJsonSize;              // Body and parsed document
+  size_t _size;                     // Response document
+  RouteMetrics *_metrics[3] = {};  // POST, PUT and PATCH
+
+  RouteMetrics *getMetrics(WebRequestMethodComposite method);
+
+ public:
+  AdmissionJsonHandler(const char *uri, WebRequestMethodComposite method,
+                       ArJsonRequestHandlerFunction onRequest,
+                       size_t maxJsonSize, size_t size = 0);
+
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+  void handleBody(AsyncWebServerRequest *request, uint8_t *data, size_t len,
+                  size_t index, size_t total) override;
+  bool isRequestHandlerTrivial() override { return false; }
+};
+
+extern AdmissionControl myAdmission;
+
+#endif  // SRC_ADMISSION_HPP_
+
+// EOF
@@ -0,0 +1,170 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <allocprof.hpp>
+
+#if defined(COLLECT_ALLOCDATA)
+#include <metrics.hpp>
+
+AllocProfiler myAllocProfiler;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+// The caller is the return address, allocations made via new or String end
+// up as the call site inside operator new or the String class.
+void* __wrap_malloc(size_t size) {
+  void* p = __real_malloc(size);
+  myAllocProfiler.recordAlloc(__builtin_return_address(0), size, p);
+  return p;
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+  void* p = __real_calloc(num, size);
+  myAllocProfiler.recordAlloc(__builtin_return_address(0), num * size, p);
+  return p;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  void* p = __real_realloc(ptr, size);
+  myAllocProfiler.recordAlloc(__builtin_return_address(0), size, p);
+  return p;
+}
+
+void __wrap_free(void* ptr) {
+  if (ptr) myAllocProfiler.recordFree();
+  __real_free(ptr);
+}
+}
+
+void AllocProfiler::recordAlloc(void* caller, size_t size, bool success) {
+  uintptr_t addr = reinterpret_cast<uintptr_t>(caller);
+
+  _allocs++;
+  _bytes += size;
+  if (!success) _failed++;
+
+  // Open addressing on the caller address, no allocations allowed in here
+  uint32_t i = (addr >> 2) % ALLOC_MAX_SITES;
+
+  for (uint32_t n = 0; n < ALLOC_MAX_SITES; n++) {
+    AllocSite& s = _sites[(i + n) % ALLOC_MAX_SITES];
+
+    if (s.caller == addr || s.caller == 0) {
+      s.caller = addr;
+      s.count++;
+      s.bytes += size;
+      if (size > s.largest) s.largest = size;
+      sample(_allocs % ALLOC_BLOCK_INTERVAL == 0);
+      return;
+    }
+  }
+
+  _dropped++;
+  sample(_allocs % ALLOC_BLOCK_INTERVAL == 0);
+}
+
+// The largest free block is expensive to find, so it is only checked when
+// the free heap reaches a new low or when block is set. Fragmentation can
+// shrink the largest block without a new low, so the allocation hook sets it
+// every ALLOC_BLOCK_INTERVAL allocations.
+void AllocProfiler::sample(bool block) {
+  if (_sampling) return;
+
+  _sampling = true;
+  uint32_t heap = ESP.getFreeHeap();
+
+  if (heap < _minFreeHeap) {
+    _minFreeHeap = heap;
+    block = true;
+  }
+
+  if (block) {
+    uint32_t free = getLargestFreeBlock();
+    if (free < _minFreeBlock) _minFreeBlock = free;
+  }
+
+  _sampling = false;
+}
+
+void AllocProfiler::writeReport(Print& out) {
+  bool done[ALLOC_MAX_SITES] = {};
+
+  sample();
+  out.printf("ALOC: allocs %u, frees %u, failed %u, bytes %u, dropped %u\n",
+             _allocs, _frees, _failed, _bytes, _dropped);
+  out.printf("ALOC: min free heap %u, min free block %u\n", _minFreeHeap,
+             _minFreeBlock);
+
+  // Busiest call sites first, resolve with addr2line against firmware.elf
+  for (int n = 0; n < ALLOC_REPORT_SITES; n++) {
+    int top = -1;
+
+    for (int i = 0; i < ALLOC_MAX_SITES; i++) {
+      if (!done[i] && _sites[i].count &&
+          (top < 0 || _sites[i].count > _sites[top].count))
+        top = i;
+    }
+
+    if (top < 0) break;
+
+    done[top] = true;
+    out.printf("ALOC: site 0x%08x count %u bytes %u largest %u\n",
+               _sites[top].caller, _sites[top].count, _sites[top].bytes,
+               _sites[top].largest);
+  }
+}
+
+void AllocProfiler::writePrometheus(Print& out) {
+  sample();
+  out.printf("# TYPE gravitymon_alloc_total counter\n"
+             "gravitymon_alloc_total %u\n"
+             "# TYPE gravitymon_alloc_free_total counter\n"
+             "gravitymon_alloc_free_total %u\n"
+             "# TYPE gravitymon_alloc_failed_total counter\n"
+             "gravitymon_alloc_failed_total %u\n"
+             "# TYPE gravitymon_alloc_bytes_total counter\n"
+             "gravitymon_alloc_bytes_total %u\n"
+             "# TYPE gravitymon_alloc_min_free_heap_bytes gauge\n"
+             "gravitymon_alloc_min_free_heap_bytes %u\n"
+             "# TYPE gravitymon_alloc_min_free_block_bytes gauge\n"
+             "gravitymon_alloc_min_free_block_bytes %u\n",
+             _allocs, _frees, _failed, _bytes, _minFreeHeap, _minFreeBlock);
+
+  out.print(F("# HELP gravitymon_alloc_site_total Allocations per call "
+              "site.\n"
+              "# TYPE gravitymon_alloc_site_total counter\n"));
+  for (int i = 0; i < ALLOC_MAX_SITES; i++) {
+    if (!_sites[i].count) continue;
+
+    out.printf("gravitymon_alloc_site_total{site=\"0x%08x\"} %u\n",
+               _sites[i].caller, _sites[i].count);
+  }
+}
+
+#endif  // COLLECT_ALLOCDATA
+
+// EOF
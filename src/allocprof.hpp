@@ -0,0 +1,80 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_ALLOCPROF_HPP_
+#define SRC_ALLOCPROF_HPP_
+
+#include <Arduino.h>
+
+// Allocation profiler, enabled with COLLECT_ALLOCDATA. It also needs the
+// linker to route the heap functions through the hooks in allocprof.cpp;
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+#if defined(COLLECT_ALLOCDATA)
+
+constexpr auto ALLOC_MAX_SITES = 32;
+constexpr auto ALLOC_REPORT_SITES = 10;
+constexpr auto ALLOC_BLOCK_INTERVAL = 64;  // Allocations between block checks
+
+struct AllocSite {
+  uintptr_t caller = 0;  // Return address of the malloc/realloc call
+  uint32_t count = 0;
+  uint32_t bytes = 0;
+  uint32_t largest = 0;
+};
+
+// Counts allocations per call site and tracks the heap low water marks. The
+// hooks can run before constructors so all members are constant initialized,
+// they are not locked so numbers from concurrent tasks may be slightly off.
+class AllocProfiler {
+ private:
+  AllocSite _sites[ALLOC_MAX_SITES];
+  uint32_t _allocs = 0;
+  uint32_t _frees = 0;
+  uint32_t _failed = 0;
+  uint32_t _bytes = 0;
+  uint32_t _dropped = 0;  // Allocations from sites that did not fit the table
+  uint32_t _minFreeHeap = UINT32_MAX;
+  uint32_t _minFreeBlock = UINT32_MAX;
+  bool _sampling = false;
+
+ public:
+  void recordAlloc(void* caller, size_t size, bool success);
+  void recordFree() { _frees++; }
+  void sample(bool block = true);
+
+  void writeReport(Print& out);
+  void writePrometheus(Print& out);
+};
+
+extern AllocProfiler myAllocProfiler;
+
+#define ALLOC_REPORT(out) myAllocProfiler.writeReport(out)
+#define ALLOC_METRICS(out) myAllocProfiler.writePrometheus(out)
+#else
+#define ALLOC_REPORT(out)
+#define ALLOC_METRICS(out)
+#endif  // COLLECT_ALLOCDATA
+
+#endif  // SRC_ALLOCPROF_HPP_
+
+// EOF
@@ -0,0 +1,51 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <arena.hpp>
+
+Arena::Arena(size_t size) { reserve(size); }
+
+Arena::~Arena() { free(_buf); }
+
+// Replaces the block with one of exactly size bytes, everything allocated from
+// the arena is released. A size of 0 only frees the block.
+bool Arena::reserve(size_t size) {
+  free(_buf);
+  _buf = size ? static_cast<uint8_t*>(malloc(size)) : nullptr;
+  _size = _buf ? size : 0;
+  _used = 0;
+  return _size == size;
+}
+
+void* Arena::alloc(size_t len) {
+  size_t start = (_used + 3) & ~static_cast<size_t>(3);
+
+  if (start + len > _size) return nullptr;
+
+  _used = start + len;
+  if (_used > _peak) _peak = _used;
+
+  return _buf + start;
+}
+
+// EOF
@@ -0,0 +1,60 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_ARENA_HPP_
+#define SRC_ARENA_HPP_
+
+#include <Arduino.h>
+
+// Bump allocator over one block that is released as a whole. Used for short
+// lived buffers so they take one exact allocation instead of several growing
+// ones, which fragments the heap.
+class Arena {
+ private:
+  uint8_t* _buf = nullptr;
+  size_t _size = 0;
+  size_t _used = 0;
+  size_t _peak = 0;
+
+ public:
+  explicit Arena(size_t size = 0);
+  ~Arena();
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  bool reserve(size_t size);
+  void* alloc(size_t len);  // 4 byte aligned, nullptr if it does not fit
+  size_t mark() const { return _used; }
+  void release(size_t mark) {
+    if (mark < _used) _used = mark;
+  }
+  void reset() { _used = 0; }
+
+  size_t size() const { return _size; }
+  size_t used() const { return _used; }
+  size_t peak() const { return _peak; }
+};
+
+#endif  // SRC_ARENA_HPP_
+
+// EOF
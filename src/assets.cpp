@@ -0,0 +1,64 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <assets.hpp>
+
+#include <assets_data.h>
+
+const size_t staticAssetCount = sizeof(staticAssets) / sizeof(staticAssets[0]);
+
+constexpr int comparePath(const char *a, const char *b) {
+  return *a != *b ? (static_cast<unsigned char>(*a) <
+                             static_cast<unsigned char>(*b)
+                         ? -1
+                         : 1)
+                  : (*a ? comparePath(a + 1, b + 1) : 0);
+}
+
+constexpr bool isSorted(size_t i) {
+  return i + 1 >= sizeof(staticAssets) / sizeof(staticAssets[0]) ||
+         (comparePath(staticAssets[i].path, staticAssets[i + 1].path) < 0 &&
+          isSorted(i + 1));
+}
+
+static_assert(isSorted(0), "Asset table must be sorted by path");
+
+const StaticAsset *findStaticAsset(const char *path) {
+  size_t low = 0, high = staticAssetCount;
+
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    int c = strcmp(staticAssets[mid].path, path);
+
+    if (!c) return &staticAssets[mid];
+
+    if (c < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return nullptr;
+}
+
+// EOF
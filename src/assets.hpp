@@ -0,0 +1,49 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_ASSETS_HPP_
+#define SRC_ASSETS_HPP_
+
+#include <Arduino.h>
+
+// Web ui files, the table is generated during the build by
+// script/create_assets.py. All files are gzip encoded.
+struct StaticAsset {
+  const char *path;
+  const char *type;
+  const char *etag;  // Quoted content hash
+  const uint8_t *data;
+  uint32_t length;
+  bool immutable;  // Content hash is part of the path
+};
+
+constexpr auto ASSET_PREFIX = "/assets";
+
+extern const StaticAsset staticAssets[];
+extern const size_t staticAssetCount;
+
+const StaticAsset *findStaticAsset(const char *path);
+
+#endif  // SRC_ASSETS_HPP_
+
+// EOF
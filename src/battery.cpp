@@ -42,7 +42,15 @@ void BatteryVoltage::read() {
   // An ESP8266 has a ADC range of 0-1023 and a maximum voltage of 3.3V
   // An ESP32 has an ADC range of 0-4095 and a maximum voltage of 3.3V
 
+#if defined(ENABLE_FIXED_POINT)
 #if defined(ESP8266)
+  const Fixed<20> scale = Fixed<20>::fromDouble(3.3 / 1023);
+#else
+  const Fixed<20> scale = Fixed<20>::fromDouble(3.3 / 4095);
+#endif
+  _batteryLevel =
+      (Fixed<20>::fromInt(v) * scale * Fixed<20>::fromDouble(factor)).toFloat();
+#elif defined(ESP8266)
   _batteryLevel = ((3.3 / 1023) * v) * factor;
 #else  // defined (ESP32)
   _batteryLevel = ((3.3 / 4095) * v) * factor;
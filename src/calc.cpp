@@ -21,99 +21,430 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
-#include <curveFitting.h>
 #include <tinyexpr.h>
 
 #include <calc.hpp>
+#include <gravitytable.hpp>
 #include <log.hpp>
 #include <utils.hpp>
 
-int createFormula(RawFormulaData &fd, char *formulaBuffer,
-                  int formulaBufferSize, int order) {
-  int noAngles = 0;
-  RawFormulaData fd2;
-
-  // Check how many valid values we have got and make sure we have a full
-  // series.
-  for (int i = 0; i < FORMULA_DATA_SIZE; i++) {
-    if (fd.a[i]) {
-      fd2.a[noAngles] = fd.a[i];
-      fd2.g[noAngles] = fd.g[i];
-      noAngles++;
+// Formula fitting is done by least squares using the normal equations. The
+// sums are collected once for all terms and every model uses the part of the
+// matrix for the terms it contains. Angle and temperature are scaled to 0..1
+// to keep the matrix well conditioned.
+constexpr auto FORMULA_DECIMALS = 100000000.0;  // Same as the printed formula
+constexpr auto FORMULA_TEMP_TERM = FORMULA_MAX_ORDER + 1;
+constexpr auto FORMULA_MIN_TEMP_RANGE = 2.0;  // C, needed to fit temp terms
+
+struct FormulaSums {
+  double sbb[FORMULA_TERMS][FORMULA_TERMS];  // sum(b_i * b_j)
+  double sby[FORMULA_TERMS];                 // sum(b_i * y)
+};
+
+static void addFormulaPoint(FormulaSums &s, double x, double t, double y,
+                            double w) {
+  double b[FORMULA_TERMS];
+
+  b[0] = 1;
+  for (int k = 1; k <= FORMULA_MAX_ORDER; k++) b[k] = b[k - 1] * x;
+  b[FORMULA_TEMP_TERM] = t;
+  b[FORMULA_TEMP_TERM + 1] = t * x;
+
+  for (int i = 0; i < FORMULA_TERMS; i++) {
+    for (int j = 0; j < FORMULA_TERMS; j++) s.sbb[i][j] += w * b[i] * b[j];
+    s.sby[i] += w * b[i] * y;
+  }
+}
+
+// List the terms used by a model, tilt^0..tilt^order and optionally the two
+// temperature terms. Returns the number of terms.
+static int formulaTerms(int order, bool surface, int *terms) {
+  int n = 0;
+
+  for (int k = 0; k <= order; k++) terms[n++] = k;
+
+  if (surface) {
+    terms[n++] = FORMULA_TEMP_TERM;
+    terms[n++] = FORMULA_TEMP_TERM + 1;
+  }
+
+  return n;
+}
+
+// Solve the normal equations for the model using gaussian elimination with
+// partial pivoting, terms not part of the model are set to zero.
+static bool solveFormula(const FormulaSums &s, int order, bool surface,
+                         FormulaKernel &kernel) {
+  int terms[FORMULA_TERMS];
+  const int n = formulaTerms(order, surface, &terms[0]);
+  double m[FORMULA_TERMS][FORMULA_TERMS + 1];
+  double v[FORMULA_TERMS];
+
+  for (int r = 0; r < n; r++) {
+    for (int c = 0; c < n; c++) m[r][c] = s.sbb[terms[r]][terms[c]];
+    m[r][n] = s.sby[terms[r]];
+  }
+
+  for (int c = 0; c < n; c++) {
+    int p = c;
+
+    for (int r = c + 1; r < n; r++)
+      if (fabs(m[r][c]) > fabs(m[p][c])) p = r;
+
+    if (fabs(m[p][c]) < 1e-12) return false;
+
+    if (p != c) {
+      for (int k = c; k <= n; k++) {
+        double t = m[c][k];
+        m[c][k] = m[p][k];
+        m[p][k] = t;
+      }
     }
+
+    for (int r = c + 1; r < n; r++) {
+      double f = m[r][c] / m[c][c];
+      for (int k = c; k <= n; k++) m[r][k] -= f * m[c][k];
+    }
+  }
+
+  for (int r = n - 1; r >= 0; r--) {
+    v[r] = m[r][n];
+    for (int k = r + 1; k < n; k++) v[r] -= m[r][k] * v[k];
+    v[r] /= m[r][r];
+  }
+
+  memset(&kernel, 0, sizeof(kernel));
+  for (int r = 0; r < n; r++) kernel.c[terms[r]] = v[r];
+
+  return true;
+}
+
+double evaluateFormula(const FormulaKernel &kernel, double angle,
+                       double tempC) {
+  double v = kernel.c[FORMULA_MAX_ORDER];
+
+  for (int k = FORMULA_MAX_ORDER - 1; k >= 0; k--) v = v * angle + kernel.c[k];
+
+  return v + tempC * (kernel.c[FORMULA_TEMP_TERM] +
+                      kernel.c[FORMULA_TEMP_TERM + 1] * angle);
+}
+
+#if defined(ENABLE_FIXED_POINT)
+// Convert the coefficients to the scaled angle and temperature, returns false
+// if they can't be represented in the Q format.
+bool compileFixedFormula(const FormulaKernel &kernel,
+                         FixedFormulaKernel &fixed) {
+  double scaled[FORMULA_TERMS];
+  double f = 1, sum = 0;
+
+  for (int k = 0; k <= FORMULA_MAX_ORDER; k++) {
+    scaled[k] = kernel.c[k] * f;
+    f *= FIXED_ANGLE_SCALE;
   }
 
+  scaled[FORMULA_TEMP_TERM] = kernel.c[FORMULA_TEMP_TERM] * FIXED_TEMP_SCALE;
+  scaled[FORMULA_TEMP_TERM + 1] =
+      kernel.c[FORMULA_TEMP_TERM + 1] * FIXED_TEMP_SCALE * FIXED_ANGLE_SCALE;
+
+  // Horner steps are bounded by the sum of the terms since |x| <= 1
+  for (int k = 0; k < FORMULA_TERMS; k++) sum += fabs(scaled[k]);
+
+  if (sum >= (1 << (31 - 24 - 1))) return false;
+
+  for (int k = 0; k < FORMULA_TERMS; k++)
+    fixed.c[k] = FixedGravity::fromDouble(scaled[k]);
+
+  return true;
+}
+
+double evaluateFixedFormula(const FixedFormulaKernel &fixed, double angle,
+                            double tempC) {
+  FixedGravity x = FixedGravity::fromDouble(angle * (1 / FIXED_ANGLE_SCALE));
+  FixedGravity t = FixedGravity::fromDouble(tempC * (1 / FIXED_TEMP_SCALE));
+  FixedGravity v = fixed.c[FORMULA_MAX_ORDER];
+
+  for (int k = FORMULA_MAX_ORDER - 1; k >= 0; k--) v = v * x + fixed.c[k];
+
+  v = v + t * (fixed.c[FORMULA_TEMP_TERM] + fixed.c[FORMULA_TEMP_TERM + 1] * x);
+  return v.toDouble();
+}
+#endif
+
+// Convert a formula in the format created by createFormula into coefficients,
+// terms are on the form c, c*tilt, c*tilt^n, c*temp or c*tilt*temp. Returns
+// false if the formula is in some other format.
+bool compileFormula(const char *formula, FormulaKernel &kernel) {
+  const char *p = formula;
+
+  memset(&kernel, 0, sizeof(kernel));
+
+  if (!*p) return false;
+
+  while (*p) {
+    char *e;
+    double c = strtod(p, &e);
+    int power = 0;
+    bool temp = false;
+
+    if (e == p) return false;
+
+    p = e;
+
+    if (!strncmp(p, "*tilt", 5)) {
+      p += 5;
+      power = 1;
+
+      if (*p == '^') {
+        power = strtol(p + 1, &e, 10);
+        if (e == p + 1 || power < 0) return false;
+        p = e;
+      }
+    }
+
+    if (!strncmp(p, "*temp", 5)) {
+      p += 5;
+      temp = true;
+    }
+
+    if (*p == '+')
+      p++;
+    else if (*p && *p != '-')
+      return false;
+
+    if (temp) {
+      if (power > 1) return false;
+      kernel.c[FORMULA_TEMP_TERM + power] += c;
+    } else {
+      if (power > FORMULA_MAX_ORDER) return false;
+      kernel.c[power] += c;
+    }
+  }
+
+  return true;
+}
+
+// Leave one out cross validation, each point is removed from the sums and
+// predicted by the remaining ones. Returns the RMS error in SG.
+static double crossValidateFormula(const FormulaSums &s, int order,
+                                   bool surface,
+                                   const FormulaDataSource &source,
+                                   double scale, double tempScale, int n) {
+  double err = 0;
+  bool valid = true;
+
+  source([&](double angle, double gravity, double tempC) {
+    FormulaSums loo = s;
+    FormulaKernel kernel;
+
+    addFormulaPoint(loo, angle / scale, tempC / tempScale, gravity, -1);
+
+    if (!valid || !solveFormula(loo, order, surface, kernel)) {
+      valid = false;
+      return;
+    }
+
+    double dev =
+        evaluateFormula(kernel, angle / scale, tempC / tempScale) - gravity;
+    err += dev * dev;
+  });
+
+  return valid ? sqrt(err / n) : -1;
+}
+
+// Find the best formula of order minOrder to maxOrder, if the points are
+// collected over a range of temperatures a surface with temperature terms is
+// also tried. The formula must pass the validation against all the data
+// points and the model with the lowest cross validated error is selected. The
+// data points are read a number of times from the source but never stored so
+// any number of points can be used.
+int createFormula(const FormulaDataSource &source, char *formulaBuffer,
+                  int formulaBufferSize, int minOrder, int maxOrder) {
+  int noAngles = 0;
+  double scale = 0, tempScale = 0;
+  double tempMin = 1000, tempMax = -1000;
+
+  source([&](double angle, double gravity, double tempC) {
+    if (fabs(angle) > scale) scale = fabs(angle);
+    if (fabs(tempC) > tempScale) tempScale = fabs(tempC);
+    if (tempC < tempMin) tempMin = tempC;
+    if (tempC > tempMax) tempMax = tempC;
+    noAngles++;
+  });
+
 #if LOG_LEVEL == 6
-  Log.verbose(
-      F("CALC: Trying to create formula using order = %d, found %d angles" CR),
-      order, noAngles);
+  Log.verbose(F("CALC: Trying to create formula using order = %d to %d, "
+                "found %d angles" CR),
+              minOrder, maxOrder, noAngles);
 #endif
 
   if (noAngles < 3) {
     writeErrorLog("CALC: Not enough values for deriving formula");
     return ERR_FORMULA_NOTENOUGHVALUES;
-  } else {
-    double coeffs[order + 1];
-    int ret = fitCurve(order, noAngles, fd2.a, fd2.g,
-                       sizeof(coeffs) / sizeof(double), coeffs);
+  }
 
-    // Returned value is 0 if no error
-    if (ret == 0) {
-#if LOG_LEVEL == 6
-      Log.verbose(F("CALC: Finshied processing data points, order = %d." CR),
-                  order);
-#endif
+  if (tempScale == 0) tempScale = 1;
+
+  FormulaSums sums = {};
+
+  source([&](double angle, double gravity, double tempC) {
+    addFormulaPoint(sums, angle / scale, tempC / tempScale, gravity, 1);
+  });
+
+  if (maxOrder > FORMULA_MAX_ORDER) maxOrder = FORMULA_MAX_ORDER;
 
-      // Print the formula based on 'order'
-      if (order == 4) {
-        snprintf(formulaBuffer, formulaBufferSize,
-                 "%.8f*tilt^4+%.8f*tilt^3+%.8f*tilt^2+%.8f*tilt+%.8f",
-                 coeffs[0], coeffs[1], coeffs[2], coeffs[3], coeffs[4]);
-      } else if (order == 3) {
-        snprintf(formulaBuffer, formulaBufferSize,
-                 "%.8f*tilt^3+%.8f*tilt^2+%.8f*tilt+%.8f", coeffs[0], coeffs[1],
-                 coeffs[2], coeffs[3]);
-      } else if (order == 2) {
-        snprintf(formulaBuffer, formulaBufferSize, "%.8f*tilt^2+%.8f*tilt+%.8f",
-                 coeffs[0], coeffs[1], coeffs[2]);
-      } else {  // order == 1
-        snprintf(formulaBuffer, formulaBufferSize, "%.8f*tilt+%.8f", coeffs[0],
-                 coeffs[1]);
+  int err = ERR_FORMULA_INTERNAL;
+  int bestOrder = 0;
+  bool bestSurface = false;
+  double bestCv = 0;
+  FormulaKernel best;
+
+  for (int surface = 0;
+       surface <= (tempMax - tempMin >= FORMULA_MIN_TEMP_RANGE ? 1 : 0);
+       surface++) {
+    for (int order = minOrder; order <= maxOrder; order++) {
+      int noTerms = order + 1 + (surface ? 2 : 0);
+      FormulaKernel kernel;
+
+      if (noTerms > noAngles) break;
+
+      if (!solveFormula(sums, order, surface, kernel)) {
+        writeErrorLog("CALC: Internal error finding formula, order %d",
+                      order);
+        continue;
       }
 
-#if LOG_LEVEL == 6
-      Log.verbose(F("CALC: Formula: %s" CR), formulaBuffer);
-#endif
+      // Convert to the unscaled values and round to what is stored in the
+      // formula so we validate the formula that will actually be used.
+      double f = 1;
+
+      for (int k = 0; k <= FORMULA_MAX_ORDER; k++) {
+        kernel.c[k] /= f;
+        f *= scale;
+      }
+
+      kernel.c[FORMULA_TEMP_TERM] /= tempScale;
+      kernel.c[FORMULA_TEMP_TERM + 1] /= tempScale * scale;
+
+      for (int k = 0; k < FORMULA_TERMS; k++)
+        kernel.c[k] =
+            round(kernel.c[k] * FORMULA_DECIMALS) / FORMULA_DECIMALS;
 
       bool valid = true;
 
-      for (int i = 0; i < 5; i++) {
-        if (fd.a[i] == 0 && valid) break;
+      source([&](double angle, double gravity, double tempC) {
+        if (!valid) return;
 
-        double g = calculateGravity(fd.a[i], 0, formulaBuffer);
-        double dev = (g - fd.g[i]) < 0 ? (fd.g[i] - g) : (g - fd.g[i]);
+        double dev = fabs(evaluateFormula(kernel, angle, tempC) - gravity);
 
-        // If the deviation is more than 2 degress we mark it as failed.
+        // If the deviation is more than the limit we mark it as failed.
         if (dev * 1000 > myConfig.getMaxFormulaCreationDeviation()) {
           writeErrorLog(
-              "CALC: Validation failed on angle %.2f, deviation too large %.4f "
-              "SG, formula order %d",
-              fd.a[i], dev * 1000, order);
+              "CALC: Validation failed on angle %.2f, deviation too large "
+              "%.4f SG, formula order %d",
+              angle, dev * 1000, order);
           valid = false;
         }
-      }
+      });
 
       if (!valid) {
-        return ERR_FORMULA_UNABLETOFFIND;
+        err = ERR_FORMULA_UNABLETOFFIND;
+        continue;
       }
 
-      Log.info(F("CALC: Found formula '%s'." CR), formulaBuffer);
-      return 0;
+      // Cross validation needs at least one point more than the number of
+      // coefficients, otherwise the first valid formula is used.
+      double cv = noAngles > noTerms
+                      ? crossValidateFormula(sums, order, surface, source,
+                                             scale, tempScale, noAngles)
+                      : -1;
+
+#if LOG_LEVEL == 6
+      char s[40];
+      snprintf(&s[0], sizeof(s), "%.6f", cv);
+      Log.verbose(
+          F("CALC: Formula order %d, temp %d, cross validated error %s." CR),
+          order, surface, &s[0]);
+#endif
+
+      if (!bestOrder || (cv >= 0 && (bestCv < 0 || cv < bestCv))) {
+        bestOrder = order;
+        bestSurface = surface;
+        bestCv = cv;
+        best = kernel;
+      }
     }
   }
 
-  writeErrorLog("CALC: Internal error finding formula.");
-  return ERR_FORMULA_INTERNAL;
+  if (!bestOrder) return err;
+
+  // Print the formula, highest order first
+  int len = 0;
+
+  for (int k = bestOrder; k >= 0 && len < formulaBufferSize; k--) {
+    if (k > 1)
+      len += snprintf(formulaBuffer + len, formulaBufferSize - len,
+                      "%.8f*tilt^%d+", best.c[k], k);
+    else if (k == 1)
+      len += snprintf(formulaBuffer + len, formulaBufferSize - len,
+                      "%.8f*tilt+", best.c[k]);
+    else
+      len += snprintf(formulaBuffer + len, formulaBufferSize - len, "%.8f",
+                      best.c[k]);
+  }
+
+  if (bestSurface && len < formulaBufferSize)
+    len += snprintf(formulaBuffer + len, formulaBufferSize - len,
+                    "+%.8f*temp+%.8f*tilt*temp", best.c[FORMULA_TEMP_TERM],
+                    best.c[FORMULA_TEMP_TERM + 1]);
+
+  if (len >= formulaBufferSize) {
+    writeErrorLog("CALC: Formula needs %d characters, buffer is too small",
+                  len + 1);
+    *formulaBuffer = 0;
+    return ERR_FORMULA_INTERNAL;
+  }
+
+  // Check that the printed formula gives the same result as the coefficients
+  // that were validated, this is what will be stored and used.
+  bool valid = true;
+
+  source([&](double angle, double gravity, double tempC) {
+    double dev = fabs(calculateGravity(angle, tempC, formulaBuffer) - gravity);
+
+    if (dev * 1000 > myConfig.getMaxFormulaCreationDeviation()) valid = false;
+  });
+
+  if (!valid) {
+    writeErrorLog("CALC: Validation of the printed formula failed");
+    *formulaBuffer = 0;
+    return ERR_FORMULA_INTERNAL;
+  }
+
+  Log.info(F("CALC: Found formula '%s'." CR), formulaBuffer);
+  return 0;
+}
+
+// Data source for the points stored in the configuration, unused entries have
+// the angle set to zero. These are all assumed to be at the calibration
+// temperature.
+static FormulaDataSource formulaDataSource(const RawFormulaData &fd) {
+  return [&fd](const FormulaPointCallback &callback) {
+    for (int i = 0; i < FORMULA_DATA_SIZE; i++)
+      if (fd.a[i])
+        callback(fd.a[i], fd.g[i], myConfig.getDefaultCalibrationTemp());
+  };
+}
+
+int createFormula(RawFormulaData &fd, char *formulaBuffer,
+                  int formulaBufferSize, int order) {
+  return createFormula(formulaDataSource(fd), formulaBuffer, formulaBufferSize,
+                       order, order);
+}
+
+int createFormula(RawFormulaData &fd, char *formulaBuffer,
+                  int formulaBufferSize) {
+  return createFormula(formulaDataSource(fd), formulaBuffer, formulaBufferSize,
+                       FORMULA_MIN_ORDER, FORMULA_MAX_ORDER);
 }
 
 double calculateGravity(double angle, double temp, const char *tempFormula) {
@@ -134,6 +465,36 @@ double calculateGravity(double angle, double temp, const char *tempFormula) {
 
   if (strlen(formula) == 0) return 0.0;
 
+  if (tempFormula == 0 && myConfig.isGravityLookup()) {
+    double g;
+    if (myGravityTable.lookup(angle, g)) return g;
+  }
+
+  // Formulas in the format created by createFormula are evaluated directly
+  // from the coefficients, the kernel is only compiled when the formula
+  // changes. Other formulas are parsed with tinyexpr.
+  static String compiledFormula;
+  static FormulaKernel kernel;
+  static bool kernelValid = false;
+#if defined(ENABLE_FIXED_POINT)
+  static FixedFormulaKernel fixedKernel;
+  static bool fixedKernelValid = false;
+#endif
+
+  if (compiledFormula != formula) {
+    compiledFormula = formula;
+    kernelValid = compileFormula(formula, kernel);
+#if defined(ENABLE_FIXED_POINT)
+    fixedKernelValid = kernelValid && compileFixedFormula(kernel, fixedKernel);
+#endif
+  }
+
+#if defined(ENABLE_FIXED_POINT)
+  if (fixedKernelValid) return evaluateFixedFormula(fixedKernel, angle, temp);
+#endif
+
+  if (kernelValid) return evaluateFormula(kernel, angle, temp);
+
   // Store variable names and pointers.
   te_variable vars[] = {{"tilt", &angle}, {"temp", &temp}};
 
@@ -157,6 +518,61 @@ double calculateGravity(double angle, double temp, const char *tempFormula) {
   return 0;
 }
 
+// Estimate how fast the gravity is changing using a linear regression over the
+// provided readings, time is in seconds. Returns the slope in SG per hour.
+double calculateGravityRate(const float *gravity, const uint32_t *time,
+                            int count) {
+  if (count < 2) return 0;
+
+  double meanT = 0, meanG = 0;
+
+  for (int i = 0; i < count; i++) {
+    meanT += time[i];
+    meanG += gravity[i];
+  }
+
+  meanT /= count;
+  meanG /= count;
+
+  double sTT = 0, sTG = 0;
+
+  for (int i = 0; i < count; i++) {
+    double t = (time[i] - meanT) / 3600;
+    sTT += t * t;
+    sTG += t * (gravity[i] - meanG);
+  }
+
+  if (sTT == 0) return 0;
+
+#if LOG_LEVEL == 6
+  char s[40];
+  snprintf(&s[0], sizeof(s), "%.6f", sTG / sTT);
+  Log.verbose(F("CALC: Gravity rate is %s SG/h from %d readings." CR), &s[0],
+              count);
+#endif
+  return sTG / sTT;
+}
+
+// Simple 1D kalman filter where the state is kept between calls. If the
+// measurement differs more than resetLimit from the estimate the filter is
+// restarted, this is to handle when the device is moved to a new batch.
+float applyKalmanFilter(FilterState &state, float measurement,
+                        float processNoise, float measurementNoise,
+                        float resetLimit) {
+  if (state.variance <= 0 || abs(measurement - state.value) > resetLimit) {
+    state.value = measurement;
+    state.variance = measurementNoise;
+    return state.value;
+  }
+
+  float variance = state.variance + processNoise;
+  float gain = variance / (variance + measurementNoise);
+
+  state.value += gain * (measurement - state.value);
+  state.variance = (1 - gain) * variance;
+  return state.value;
+}
+
 // Do a standard gravity temperature correction. This is a simple way to adjust
 // for differnt worth temperatures. This function uses C as temperature.
 //
@@ -168,6 +584,21 @@ double gravityTemperatureCorrectionC(double gravitySG, double tempC,
                 "temp %F, calTemp %F." CR),
               gravitySG, tempC, calTempC);
 #endif
+
+#if defined(ENABLE_FIXED_POINT)
+  // Same formula as below with the temperature in F scaled by 1/100
+  static const FixedGravity c[] = {FixedGravity::fromDouble(1.00130346),
+                                   FixedGravity::fromDouble(-0.0134722124),
+                                   FixedGravity::fromDouble(0.0204052596),
+                                   FixedGravity::fromDouble(-0.00232820948)};
+  const FixedGravity offset = FixedGravity::fromDouble(0.32);
+
+  FixedGravity t = FixedGravity::fromDouble(tempC * 0.018) + offset;
+  FixedGravity cal = FixedGravity::fromDouble(calTempC * 0.018) + offset;
+  FixedGravity g = FixedGravity::fromDouble(gravitySG) *
+                   (fixedPolynomial(c, t) / fixedPolynomial(c, cal));
+  return g.toDouble();
+#else
   double tempF = convertCtoF(tempC);
   double calTempF = convertCtoF(calTempC);
   const char *formula =
@@ -201,6 +632,7 @@ double gravityTemperatureCorrectionC(double gravitySG, double tempC,
       "CALC: Failed to parse expression for gravity temperature correction %d",
       err);
   return gravitySG;
+#endif
 }
 
 // EOF
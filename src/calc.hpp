@@ -25,17 +25,64 @@ SOFTWARE.
 #define SRC_CALC_HPP_
 
 #include <config.hpp>
+#include <functional>
+#include <rtcmem.hpp>
 
 constexpr auto ERR_FORMULA_NOTENOUGHVALUES = -1;
 constexpr auto ERR_FORMULA_INTERNAL = -2;
 constexpr auto ERR_FORMULA_UNABLETOFFIND = -3;
+constexpr auto FORMULA_MIN_ORDER = 2;  // Lowest order tried when auto selecting
+constexpr auto FORMULA_MAX_ORDER = 4;
+constexpr auto FORMULA_TERMS = FORMULA_MAX_ORDER + 3;
+
+// Coefficients for the formula, tilt^0..tilt^FORMULA_MAX_ORDER followed by
+// temp and tilt*temp.
+struct FormulaKernel {
+  double c[FORMULA_TERMS];
+};
+
+// A data source calls the callback for each (angle, gravity, temp) point, it
+// must provide the same points every time it's called.
+typedef std::function<void(double angle, double gravity, double tempC)>
+    FormulaPointCallback;
+typedef std::function<void(const FormulaPointCallback &callback)>
+    FormulaDataSource;
 
 double calculateGravity(double angle, double tempC,
                         const char *tempFormula = 0);
+bool compileFormula(const char *formula, FormulaKernel &kernel);
+double evaluateFormula(const FormulaKernel &kernel, double angle,
+                       double tempC);
+
+#if defined(ENABLE_FIXED_POINT)
+// Angle and temperature are scaled to 0..1 so all the terms of the formula are
+// within the range of the Q format.
+typedef Fixed<24> FixedGravity;
+constexpr auto FIXED_ANGLE_SCALE = 90.0;
+constexpr auto FIXED_TEMP_SCALE = 100.0;
+
+struct FixedFormulaKernel {
+  FixedGravity c[FORMULA_TERMS];
+};
+
+bool compileFixedFormula(const FormulaKernel &kernel,
+                         FixedFormulaKernel &fixed);
+double evaluateFixedFormula(const FixedFormulaKernel &fixed, double angle,
+                            double tempC);
+#endif
 double gravityTemperatureCorrectionC(double gravity, double tempC,
                                      double calTempC);
 int createFormula(RawFormulaData &fd, char *formulaBuffer,
                   int formulaBufferSize, int order);
+int createFormula(RawFormulaData &fd, char *formulaBuffer,
+                  int formulaBufferSize);
+int createFormula(const FormulaDataSource &source, char *formulaBuffer,
+                  int formulaBufferSize, int minOrder, int maxOrder);
+double calculateGravityRate(const float *gravity, const uint32_t *time,
+                            int count);
+float applyKalmanFilter(FilterState &state, float measurement,
+                        float processNoise, float measurementNoise,
+                        float resetLimit);
 
 #endif  // SRC_CALC_HPP_
 
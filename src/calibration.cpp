@@ -0,0 +1,184 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <calibration.hpp>
+#include <config.hpp>
+#include <log.hpp>
+#include <main.hpp>
+
+constexpr uint32_t CALIBRATION_MAGIC = 0x4c414347;  // GCAL
+constexpr uint16_t CALIBRATION_VERSION = 1;
+
+CalibrationStore myCalibrationStore;
+
+bool CalibrationStore::writeHeader(File &f) {
+  CalibrationHeader h = {CALIBRATION_MAGIC, CALIBRATION_VERSION,
+                         sizeof(CalibrationPoint)};
+  return f.write(reinterpret_cast<const uint8_t *>(&h), sizeof(h)) ==
+         sizeof(h);
+}
+
+bool CalibrationStore::checkHeader(File &f) {
+  CalibrationHeader h;
+
+  if (f.read(reinterpret_cast<uint8_t *>(&h), sizeof(h)) != sizeof(h))
+    return false;
+
+  if (h.magic != CALIBRATION_MAGIC || h.version != CALIBRATION_VERSION ||
+      h.pointSize != sizeof(CalibrationPoint)) {
+    Log.warning(F("CALI: Calibration file has unknown format." CR));
+    return false;
+  }
+
+  return true;
+}
+
+int CalibrationStore::size() {
+  File f = LittleFS.open(CALIBRATION_FILENAME, "r");
+
+  if (!f) return 0;
+
+  int n = f.size() > sizeof(CalibrationHeader) && checkHeader(f)
+              ? (f.size() - sizeof(CalibrationHeader)) /
+                    sizeof(CalibrationPoint)
+              : 0;
+  f.close();
+  return n;
+}
+
+bool CalibrationStore::clear() {
+  Log.notice(F("CALI: Removing calibration points." CR));
+  return !LittleFS.exists(CALIBRATION_FILENAME) ||
+         LittleFS.remove(CALIBRATION_FILENAME);
+}
+
+void CalibrationStore::forEach(
+    std::function<void(const CalibrationPoint &)> callback) {
+  File f = LittleFS.open(CALIBRATION_FILENAME, "r");
+
+  if (!f) return;
+
+  if (checkHeader(f)) {
+    CalibrationPoint p;
+
+    while (f.read(reinterpret_cast<uint8_t *>(&p), sizeof(p)) == sizeof(p))
+      callback(p);
+  }
+
+  f.close();
+}
+
+void CalibrationStore::exportCsv(Print &out) {
+  out.print("angle,gravity,temp\n");
+
+  forEach([&out](const CalibrationPoint &p) {
+    out.print(p.angle, DECIMALS_TILT);
+    out.print(',');
+    out.print(p.gravity, DECIMALS_SG);
+    out.print(',');
+    out.print(p.tempC, DECIMALS_TEMP);
+    out.print('\n');
+  });
+}
+
+// The import is written to a temporary file that replaces the current points
+// when the import is completed, data can arrive in any number of chunks.
+void CalibrationStore::beginImport() {
+  Log.notice(F("CALI: Starting import of calibration points." CR));
+  _importLineLen = 0;
+  _importCount = 0;
+  _importFile = LittleFS.open(CALIBRATION_TMP_FILENAME, "w");
+
+  if (_importFile) writeHeader(_importFile);
+}
+
+void CalibrationStore::importCsv(const uint8_t *data, size_t len) {
+  if (!_importFile) return;
+
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == '\n' || data[i] == '\r') {
+      importLine();
+    } else if (_importLineLen < static_cast<int>(sizeof(_importLine) - 1)) {
+      _importLine[_importLineLen++] = data[i];
+    }
+  }
+}
+
+void CalibrationStore::importLine() {
+  _importLine[_importLineLen] = 0;
+  _importLineLen = 0;
+
+  // Skip header and empty lines
+  if (!isdigit(_importLine[0]) && _importLine[0] != '-' &&
+      _importLine[0] != '.')
+    return;
+
+  if (_importCount >= CALIBRATION_MAX_POINTS) return;
+
+  char *p = &_importLine[0];
+  CalibrationPoint cp;
+
+  cp.angle = strtod(p, &p);
+  if (*p++ != ',') return;
+  cp.gravity = strtod(p, &p);
+  cp.tempC = *p == ',' ? strtod(p + 1, &p)
+                       : myConfig.getDefaultCalibrationTemp();
+
+  if (cp.angle == 0 || cp.gravity == 0) return;
+
+  _importFile.write(reinterpret_cast<const uint8_t *>(&cp), sizeof(cp));
+  _importCount++;
+}
+
+int CalibrationStore::endImport(bool commit) {
+  if (!_importFile) return -1;
+
+  if (_importLineLen) importLine();
+
+  _importFile.close();
+
+  if (!commit) {
+    Log.notice(F("CALI: Import of calibration points cancelled." CR));
+    LittleFS.remove(CALIBRATION_TMP_FILENAME);
+    return -1;
+  }
+
+  // Keep the current points if there was nothing valid in the import
+  if (!_importCount) {
+    Log.warning(F("CALI: No valid calibration points in import." CR));
+    LittleFS.remove(CALIBRATION_TMP_FILENAME);
+    return 0;
+  }
+
+  // Rename replaces the current points in one step
+  if (!LittleFS.rename(CALIBRATION_TMP_FILENAME, CALIBRATION_FILENAME)) {
+    Log.error(F("CALI: Failed to store imported calibration points." CR));
+    LittleFS.remove(CALIBRATION_TMP_FILENAME);
+    return -1;
+  }
+
+  Log.notice(F("CALI: Imported %d calibration points." CR), _importCount);
+  return _importCount;
+}
+
+// EOF
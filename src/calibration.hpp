@@ -0,0 +1,76 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_CALIBRATION_HPP_
+#define SRC_CALIBRATION_HPP_
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include <functional>
+
+constexpr auto CALIBRATION_FILENAME = "/calibration.dat";
+constexpr auto CALIBRATION_TMP_FILENAME = "/calibration.tmp";
+constexpr auto CALIBRATION_MAX_POINTS = 500;
+
+struct CalibrationPoint {
+  float angle;
+  float gravity;  // SG
+  float tempC;
+};
+
+struct CalibrationHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t pointSize;
+};
+
+// Calibration points used for formula creation, stored as fixed size binary
+// records so any number of points can be read one at a time.
+class CalibrationStore {
+ private:
+  File _importFile;
+  char _importLine[48];
+  int _importLineLen = 0;
+  int _importCount = 0;
+
+  bool writeHeader(File &f);
+  bool checkHeader(File &f);
+  void importLine();
+
+ public:
+  int size();
+  bool clear();
+  void forEach(std::function<void(const CalibrationPoint &)> callback);
+
+  void exportCsv(Print &out);
+  void beginImport();
+  void importCsv(const uint8_t *data, size_t len);
+  int endImport(bool commit);
+};
+
+extern CalibrationStore myCalibrationStore;
+
+#endif  // SRC_CALIBRATION_HPP_
+
+// EOF
@@ -28,7 +28,464 @@ SOFTWARE.
 #include <resources.hpp>
 
 GravmonConfig::GravmonConfig(String baseMDNS, String fileName)
-    : BaseConfig(baseMDNS, fileName, JSON_BUFFER_SIZE_XL) {}
+    : BaseConfig(baseMDNS, fileName, JSON_BUFFER_SIZE_XL),
+      _configFile(fileName) {}
+
+bool ConfigStrings::set(uint8_t slot, const char* s) {
+  size_t cap = configStringCapacity(slot);
+  char* p = &_data[configStringOffset(slot)];
+  size_t len = s ? strlen(s) : 0;
+
+  if (len > cap) len = cap;
+
+  memcpy(p, s ? s : "", len);
+  p[len] = 0;
+  return s == nullptr || s[len] == 0;
+}
+
+// Print sink that only calculates a FNV-1a hash of the data written to it
+class HashPrint : public Print {
+ private:
+  uint32_t _hash = 2166136261u;
+
+ public:
+  size_t write(uint8_t c) override {
+    _hash = (_hash ^ c) * 16777619u;
+    return 1;
+  }
+  size_t write(const uint8_t* buf, size_t len) override {
+    for (size_t i = 0; i < len; i++) write(buf[i]);
+    return len;
+  }
+  uint32_t getHash() { return _hash; }
+};
+
+uint32_t GravmonConfig::fileHash() {
+  HashPrint hash;
+  File file = LittleFS.open(_configFile, "r");
+
+  if (file) {
+    uint8_t buf[64];
+    size_t len;
+
+    while ((len = file.read(buf, sizeof(buf))) > 0) hash.write(buf, len);
+
+    file.close();
+  }
+
+  return hash.getHash();
+}
+
+// Replaces the write in BaseConfig, so saves requested by the framework are
+// atomic as well. Returns false if the configuration could not be saved. When
+// written is set it tells if the file was updated, an unchanged configuration
+// is not written.
+bool GravmonConfig::saveFile(bool* written) {
+  if (written) *written = false;
+
+  DynamicJsonDocument doc(JSON_BUFFER_SIZE_XL);
+  JsonObject obj = doc.to<JsonObject>();
+  HashPrint hash;
+
+  createJson(obj);
+  serializeJson(obj, hash);
+
+  // Compare with what is stored on flash, the file is small so reading it
+  // back is much cheaper than an erase and write cycle.
+  if (hash.getHash() == fileHash()) {
+    Log.notice(F("CFG : Configuration unchanged, skipping write." CR));
+    _saveNeeded = false;
+    return true;
+  }
+
+  // Write to a temporary file first so a reset during the write never leaves
+  // a truncated configuration behind.
+  String tmp = _configFile + ".tmp";
+  File file = LittleFS.open(tmp, "w");
+
+  if (!file) {
+    Log.error(F("CFG : Failed to open %s for writing." CR), tmp.c_str());
+    return false;
+  }
+
+  size_t len = serializeJson(obj, file);
+  file.close();
+
+  if (!len || !LittleFS.rename(tmp, _configFile)) {
+    Log.error(F("CFG : Failed to save configuration to %s." CR),
+              _configFile.c_str());
+    LittleFS.remove(tmp);
+    return false;
+  }
+
+  Log.notice(F("CFG : Configuration saved to %s, %d bytes." CR),
+             _configFile.c_str(), len);
+  _saveNeeded = false;
+  if (written) *written = true;
+  return true;
+}
+
+// Values that do not map to a single member
+static void readBleFormat(GravmonConfig& cfg, JsonVariantConst v) {
+  cfg.setBleFormat(v.as<int>());
+}
+
+static void writeBleFormat(GravmonConfig& cfg, JsonObject& doc,
+                           const char* key) {
+  doc[key] = cfg.getBleFormat();
+}
+
+template <typename T>
+static void readIfSet(JsonVariantConst v, const char* key, T& value) {
+  if (!v[key].isNull()) value = v[key].as<T>();
+}
+
+static void readGyroCalibration(GravmonConfig& cfg, JsonVariantConst v) {
+  RawGyroData cal = cfg.getGyroCalibration();
+  readIfSet(v, "ax", cal.ax);
+  readIfSet(v, "ay", cal.ay);
+  readIfSet(v, "az", cal.az);
+  readIfSet(v, "gx", cal.gx);
+  readIfSet(v, "gy", cal.gy);
+  readIfSet(v, "gz", cal.gz);
+  cfg.setGyroCalibration(cal);
+}
+
+static void writeGyroCalibration(GravmonConfig& cfg, JsonObject& doc,
+                                 const char* key) {
+  const RawGyroData& cal = cfg.getGyroCalibration();
+  JsonObject obj = doc.createNestedObject(key);
+  obj["ax"] = cal.ax;
+  obj["ay"] = cal.ay;
+  obj["az"] = cal.az;
+  obj["gx"] = cal.gx;
+  obj["gy"] = cal.gy;
+  obj["gz"] = cal.gz;
+}
+
+static void readAccelScale(GravmonConfig& cfg, JsonVariantConst v) {
+  AccelScaleData scale = cfg.getAccelScale();
+  readIfSet(v, "ox", scale.ox);
+  readIfSet(v, "oy", scale.oy);
+  readIfSet(v, "oz", scale.oz);
+  readIfSet(v, "sx", scale.sx);
+  readIfSet(v, "sy", scale.sy);
+  readIfSet(v, "sz", scale.sz);
+  cfg.setAccelScale(scale);
+}
+
+static void writeAccelScale(GravmonConfig& cfg, JsonObject& doc,
+                            const char* key) {
+  const AccelScaleData& scale = cfg.getAccelScale();
+  JsonObject obj = doc.createNestedObject(key);
+  obj["ox"] = scale.ox;
+  obj["oy"] = scale.oy;
+  obj["oz"] = scale.oz;
+  obj["sx"] = scale.sx;
+  obj["sy"] = scale.sy;
+  obj["sz"] = scale.sz;
+}
+
+static void readFormulaData(GravmonConfig& cfg, JsonVariantConst v) {
+  RawFormulaData fd = cfg.getFormulaData();
+  int i = 0;
+
+  for (JsonVariantConst p : v.as<JsonArrayConst>()) {
+    if (i < FORMULA_DATA_SIZE) {
+      fd.a[i] = p["a"].as<double>();
+      fd.g[i] = p["g"].as<double>();
+    }
+    i++;
+  }
+
+  if (i != FORMULA_DATA_SIZE) {
+    Log.warning(F("Size of formula array is not as expected (%d)" CR), i);
+  }
+
+  cfg.setFormulaData(fd);
+}
+
+static void writeFormulaData(GravmonConfig& cfg, JsonObject& doc,
+                             const char* key) {
+  const RawFormulaData& fd = cfg.getFormulaData();
+  JsonArray array = doc.createNestedArray(key);
+
+  for (int i = 0; i < FORMULA_DATA_SIZE; i++) {
+    JsonObject p = array.createNestedObject();
+    p["a"] = serialized(String(fd.a[i], DECIMALS_TILT));
+    p["g"] = serialized(String(fd.g[i], DECIMALS_SG));
+  }
+}
+
+// Validators, a rejected value leaves the current setting unchanged
+static bool validGravityFormat(JsonVariantConst v) {
+  const char* s = v.as<const char*>();
+  return s && (*s == 'G' || *s == 'P');
+}
+
+static bool validSleepIntervalLimit(JsonVariantConst v) {
+  int t = v.as<int>();
+  return t >= 10 && t <= 86400;
+}
+
+static bool validTempSensorResolution(JsonVariantConst v) {
+  int t = v.as<int>();
+  return t >= 9 && t <= 12;
+}
+
+// Empty or TLS_FINGERPRINT_DIGITS hex digits, separators are optional
+static bool validFingerprint(JsonVariantConst v) {
+  const char* s = v.as<const char*>();
+  int digits = 0;
+
+  if (!s) return false;
+
+  for (; *s; s++) {
+    if (isxdigit(*s))
+      digits++;
+    else if (*s != ':' && *s != ' ')
+      return false;
+  }
+
+  return digits == 0 || digits == TLS_FINGERPRINT_DIGITS;
+}
+
+static bool validGyroTemp(JsonVariantConst) {
+#if defined(FLOATY)
+  return false;  // Floaty hardware dont have a temp sensor, uses gyro temp
+#else
+  return true;
+#endif
+}
+
+static bool validVoltagePin(JsonVariantConst) {
+#if defined(ESP32LITE)  // Can only be configured for the floaty hardware
+  return true;
+#else
+  return false;
+#endif
+}
+
+// The getter reports the fixed pin on boards where it can't be configured
+static void readVoltagePin(GravmonConfig& cfg, JsonVariantConst v) {
+  cfg.setVoltagePin(v.as<int>());
+}
+
+static void writeVoltagePin(GravmonConfig& cfg, JsonObject& doc,
+                            const char* key) {
+  doc[key] = cfg.getVoltagePin();
+}
+
+// Settings owned by GravmonConfig, in the order they are written. The base
+// class settings (wifi, push targets etc) are handled by BaseConfig. To add a
+// setting; add the member and one line here.
+struct ConfigFieldTable {
+  static constexpr ConfigField fields[] PROGMEM = {
+      {PARAM_BLE_TILT_COLOR, CFG_STR_BLE_TILT_COLOR},
+      {PARAM_BLE_FORMAT, readBleFormat, writeBleFormat},
+      {PARAM_USE_WIFI_DIRECT, &GravmonConfig::_wifiDirect},
+      {PARAM_TOKEN, CFG_STR_TOKEN},
+      {PARAM_TOKEN2, CFG_STR_TOKEN2},
+      {PARAM_SLEEP_INTERVAL, &GravmonConfig::_sleepInterval},
+      {PARAM_VOLTAGE_FACTOR, &GravmonConfig::_voltageFactor, DECIMALS_BATTERY},
+      {PARAM_VOLTAGE_CONFIG, &GravmonConfig::_voltageConfig, DECIMALS_BATTERY},
+      {PARAM_GRAVITY_FORMULA, CFG_STR_GRAVITY_FORMULA},
+      {PARAM_GRAVITY_FORMAT, &GravmonConfig::_gravityFormat,
+       validGravityFormat},
+      {PARAM_TEMP_ADJ, &GravmonConfig::_tempSensorAdjC, DECIMALS_TEMP},
+      {PARAM_GRAVITY_TEMP_ADJ, &GravmonConfig::_gravityTempAdj},
+      {PARAM_GYRO_TEMP, &GravmonConfig::_gyroTemp, validGyroTemp},
+      {PARAM_GYRO_DISABLED, &GravmonConfig::_gyroDisabled},
+      {PARAM_STORAGE_SLEEP, &GravmonConfig::_storageSleep},
+      {PARAM_SKIP_SSL_ON_TEST, &GravmonConfig::_skipSslOnTest},
+      {PARAM_VOLTAGE_PIN, readVoltagePin, writeVoltagePin, validVoltagePin},
+      {PARAM_GYRO_CALIBRATION, readGyroCalibration, writeGyroCalibration},
+      {PARAM_GYRO_SCALE, readAccelScale, writeAccelScale},
+      {PARAM_FORMULA_DATA, readFormulaData, writeFormulaData},
+      {PARAM_GYRO_READ_COUNT, &GravmonConfig::_gyroReadCount},
+      {PARAM_GYRO_MOVING_THREASHOLD,
+       &GravmonConfig::_gyroSensorMovingThreashold},
+      {PARAM_FORMULA_DEVIATION, &GravmonConfig::_maxFormulaCreationDeviation},
+      {PARAM_FORMULA_CALIBRATION_TEMP,
+       &GravmonConfig::_defaultCalibrationTemp},
+      {PARAM_PUSH_INTERVAL_POST, &GravmonConfig::_pushIntervalPost},
+      {PARAM_PUSH_INTERVAL_POST2, &GravmonConfig::_pushIntervalPost2},
+      {PARAM_PUSH_INTERVAL_GET, &GravmonConfig::_pushIntervalGet},
+      {PARAM_PUSH_INTERVAL_INFLUX, &GravmonConfig::_pushIntervalInflux},
+      {PARAM_PUSH_INTERVAL_MQTT, &GravmonConfig::_pushIntervalMqtt},
+      {PARAM_TEMPSENSOR_RESOLUTION, &GravmonConfig::_tempSensorResolution,
+       validTempSensorResolution},
+      {PARAM_IGNORE_LOW_ANGLES, &GravmonConfig::_ignoreLowAnges},
+      {PARAM_BATTERY_SAVING, &GravmonConfig::_batterySaving},
+      {PARAM_PUSH_DEADBAND_GRAVITY, &GravmonConfig::_pushDeadbandGravity,
+       DECIMALS_SG},
+      {PARAM_PUSH_DEADBAND_TEMP, &GravmonConfig::_pushDeadbandTemp,
+       DECIMALS_TEMP},
+      {PARAM_PUSH_MAX_SILENCE, &GravmonConfig::_pushMaxSilence},
+      {PARAM_SLEEP_ADAPTIVE, &GravmonConfig::_sleepAdaptive},
+      {PARAM_SLEEP_INTERVAL_MIN, &GravmonConfig::_sleepIntervalMin,
+       validSleepIntervalLimit},
+      {PARAM_SLEEP_INTERVAL_MAX, &GravmonConfig::_sleepIntervalMax,
+       validSleepIntervalLimit},
+      {PARAM_GRAVITY_FILTER, &GravmonConfig::_gravityFilter},
+      {PARAM_GYRO_FUSION, &GravmonConfig::_gyroFusion},
+      {PARAM_GYRO_STILL_TIME, &GravmonConfig::_gyroStillTime},
+      {PARAM_GRAVITY_LOOKUP, &GravmonConfig::_gravityLookup},
+      {PARAM_HTTP_POST_FINGERPRINT, CFG_STR_FINGERPRINT_POST, validFingerprint},
+      {PARAM_HTTP_POST2_FINGERPRINT, CFG_STR_FINGERPRINT_POST2,
+       validFingerprint},
+      {PARAM_HTTP_GET_FINGERPRINT, CFG_STR_FINGERPRINT_GET, validFingerprint},
+      {PARAM_INFLUXDB2_FINGERPRINT, CFG_STR_FINGERPRINT_INFLUX,
+       validFingerprint},
+  };
+  static constexpr size_t count = sizeof(fields) / sizeof(fields[0]);
+
+  // Every key must have a unique hash so a lookup is one hash, a binary
+  // search and a single strcmp to confirm the match.
+  static constexpr bool uniqueFrom(size_t i, size_t j) {
+    return j >= count ? true
+                      : fields[i].hash != fields[j].hash &&
+                            uniqueFrom(i, j + 1);
+  }
+  static constexpr bool unique(size_t i = 0) {
+    return i >= count ? true : uniqueFrom(i, i + 1) && unique(i + 1);
+  }
+
+  // Position of a field when the table is sorted on hash, the number of keys
+  // with a lower hash.
+  static constexpr size_t rank(size_t i, size_t j = 0) {
+    return j >= count ? 0
+                      : (fields[j].hash < fields[i].hash ? 1 : 0) +
+                            rank(i, j + 1);
+  }
+  static constexpr uint8_t at(size_t pos, size_t i = 0) {
+    return i >= count ? 0 : (rank(i) == pos ? i : at(pos, i + 1));
+  }
+
+  static ConfigField get(size_t i) {
+    ConfigField f;
+    memcpy_P(&f, &fields[i], sizeof(f));
+    return f;
+  }
+
+  static bool find(const char* key, ConfigField& f);
+};
+
+constexpr ConfigField ConfigFieldTable::fields[] PROGMEM;
+constexpr size_t ConfigFieldTable::count;
+
+static_assert(ConfigFieldTable::count < 256, "Field index is 8 bits");
+static_assert(ConfigFieldTable::unique(), "Config key hash collision");
+
+// Field index sorted on hash, built by the compiler from the table above
+template <size_t... I>
+struct ConfigIndexList {};
+
+template <size_t N, size_t... I>
+struct MakeConfigIndexList : MakeConfigIndexList<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct MakeConfigIndexList<0, I...> {
+  typedef ConfigIndexList<I...> type;
+};
+
+struct ConfigFieldOrder {
+  uint8_t index[ConfigFieldTable::count];
+};
+
+template <size_t... I>
+constexpr ConfigFieldOrder makeFieldOrder(ConfigIndexList<I...>) {
+  return {{ConfigFieldTable::at(I)...}};
+}
+
+static constexpr ConfigFieldOrder fieldOrder PROGMEM =
+    makeFieldOrder(MakeConfigIndexList<ConfigFieldTable::count>::type());
+
+constexpr bool isSorted(size_t i) {
+  return i + 1 >= ConfigFieldTable::count ||
+         (ConfigFieldTable::fields[fieldOrder.index[i]].hash <
+              ConfigFieldTable::fields[fieldOrder.index[i + 1]].hash &&
+          isSorted(i + 1));
+}
+
+static_assert(isSorted(0), "Config field order must be sorted by hash");
+
+bool ConfigFieldTable::find(const char* key, ConfigField& f) {
+  uint32_t h = configKeyHash(key);
+  size_t lo = 0, hi = count;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    f = get(pgm_read_byte(&fieldOrder.index[mid]));
+
+    if (f.hash == h) return strcmp(f.key, key) == 0;
+
+    if (f.hash < h)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return false;
+}
+
+void GravmonConfig::createField(const ConfigField& f, JsonObject& doc) {
+  switch (f.type) {
+    case ConfigFieldType::Bool:
+      doc[f.key] = this->*f.target.b;
+      break;
+    case ConfigFieldType::Int:
+      doc[f.key] = this->*f.target.i;
+      break;
+    case ConfigFieldType::Float:
+      if (f.decimals)
+        doc[f.key] = serialized(String(this->*f.target.f, f.decimals));
+      else
+        doc[f.key] = this->*f.target.f;
+      break;
+    case ConfigFieldType::Char:
+      doc[f.key] = String(this->*f.target.c);
+      break;
+    case ConfigFieldType::Text:
+      doc[f.key] = _strings.get(f.target.s);
+      break;
+    case ConfigFieldType::Custom:
+      f.target.io.write(*this, doc, f.key);
+      break;
+  }
+}
+
+void GravmonConfig::parseField(const ConfigField& f, JsonVariantConst v) {
+  if (f.validator && !f.validator(v)) {
+    Log.warning(F("CFG : Ignoring invalid value for %s." CR), f.key);
+    return;
+  }
+
+  switch (f.type) {
+    case ConfigFieldType::Bool:
+      this->*f.target.b = v.as<bool>();
+      break;
+    case ConfigFieldType::Int:
+      this->*f.target.i = v.as<int>();
+      break;
+    case ConfigFieldType::Float:
+      this->*f.target.f = v.as<float>();
+      break;
+    case ConfigFieldType::Char:
+      this->*f.target.c = v.as<String>().charAt(0);
+      break;
+    case ConfigFieldType::Text:
+      if (!_strings.set(f.target.s, v.as<const char*>()))
+        Log.warning(F("CFG : Value for %s truncated to %d chars." CR), f.key,
+                    configStringCapacity(f.target.s));
+      break;
+    case ConfigFieldType::Custom:
+      f.target.io.read(*this, v);
+      break;
+  }
+
+  _saveNeeded = true;
+}
 
 void GravmonConfig::createJson(JsonObject& doc) {
   // Call base class functions
@@ -37,54 +494,8 @@ void GravmonConfig::createJson(JsonObject& doc) {
   createJsonOta(doc);
   createJsonPush(doc);
 
-  doc[PARAM_BLE_TILT_COLOR] = getBleTiltColor();
-  doc[PARAM_BLE_FORMAT] = getBleFormat();
-  doc[PARAM_USE_WIFI_DIRECT] = isWifiDirect();
-  doc[PARAM_TOKEN] = getToken();
-  doc[PARAM_TOKEN2] = getToken2();
-  doc[PARAM_SLEEP_INTERVAL] = getSleepInterval();
-  doc[PARAM_VOLTAGE_FACTOR] =
-      serialized(String(getVoltageFactor(), DECIMALS_BATTERY));
-  doc[PARAM_VOLTAGE_CONFIG] =
-      serialized(String(getVoltageConfig(), DECIMALS_BATTERY));
-  doc[PARAM_GRAVITY_FORMULA] = getGravityFormula();
-  doc[PARAM_GRAVITY_FORMAT] = String(getGravityFormat());
-  doc[PARAM_TEMP_ADJ] = serialized(String(getTempSensorAdjC(), DECIMALS_TEMP));
-  doc[PARAM_GRAVITY_TEMP_ADJ] = isGravityTempAdj();
-  doc[PARAM_GYRO_TEMP] = isGyroTemp();
-  doc[PARAM_GYRO_DISABLED] = isGyroDisabled();
-  doc[PARAM_STORAGE_SLEEP] = isStorageSleep();
-  doc[PARAM_SKIP_SSL_ON_TEST] = isSkipSslOnTest();
-  doc[PARAM_VOLTAGE_PIN] = getVoltagePin();
-
-  JsonObject cal = doc.createNestedObject(PARAM_GYRO_CALIBRATION);
-  cal["ax"] = _gyroCalibration.ax;
-  cal["ay"] = _gyroCalibration.ay;
-  cal["az"] = _gyroCalibration.az;
-  cal["gx"] = _gyroCalibration.gx;
-  cal["gy"] = _gyroCalibration.gy;
-  cal["gz"] = _gyroCalibration.gz;
-
-  JsonArray fdArray = doc.createNestedArray(PARAM_FORMULA_DATA);
-  for (int i = 0; i < FORMULA_DATA_SIZE; i++) {
-    JsonObject fd = fdArray.createNestedObject();
-    fd["a"] = serialized(String(_formulaData.a[i], DECIMALS_TILT));
-    fd["g"] = serialized(String(_formulaData.g[i], DECIMALS_SG));
-  }
-
-  doc[PARAM_GYRO_READ_COUNT] = this->getGyroReadCount();
-  // doc[PARAM_GYRO_READ_DELAY] = this->getGyroReadDelay();
-  doc[PARAM_GYRO_MOVING_THREASHOLD] = this->getGyroSensorMovingThreashold();
-  doc[PARAM_FORMULA_DEVIATION] = this->getMaxFormulaCreationDeviation();
-  doc[PARAM_FORMULA_CALIBRATION_TEMP] = this->getDefaultCalibrationTemp();
-  doc[PARAM_PUSH_INTERVAL_POST] = this->getPushIntervalPost();
-  doc[PARAM_PUSH_INTERVAL_POST2] = this->getPushIntervalPost2();
-  doc[PARAM_PUSH_INTERVAL_GET] = this->getPushIntervalGet();
-  doc[PARAM_PUSH_INTERVAL_INFLUX] = this->getPushIntervalInflux();
-  doc[PARAM_PUSH_INTERVAL_MQTT] = this->getPushIntervalMqtt();
-  doc[PARAM_TEMPSENSOR_RESOLUTION] = this->getTempSensorResolution();
-  doc[PARAM_IGNORE_LOW_ANGLES] = this->isIgnoreLowAnges();
-  doc[PARAM_BATTERY_SAVING] = this->isBatterySaving();
+  for (size_t i = 0; i < ConfigFieldTable::count; i++)
+    createField(ConfigFieldTable::get(i), doc);
 }
 
 void GravmonConfig::parseJson(JsonObject& doc) {
@@ -94,101 +505,14 @@ void GravmonConfig::parseJson(JsonObject& doc) {
   parseJsonOta(doc);
   parseJsonPush(doc);
 
-  if (!doc[PARAM_BLE_TILT_COLOR].isNull())
-    setBleTiltColor(doc[PARAM_BLE_TILT_COLOR]);
-  if (!doc[PARAM_BLE_FORMAT].isNull())
-    setBleFormat(doc[PARAM_BLE_FORMAT].as<int>());
-
-  if (!doc[PARAM_USE_WIFI_DIRECT].isNull())
-    setWifiDirect(doc[PARAM_USE_WIFI_DIRECT]);
-
-  if (!doc[PARAM_TOKEN].isNull()) setToken(doc[PARAM_TOKEN]);
-  if (!doc[PARAM_TOKEN2].isNull()) setToken2(doc[PARAM_TOKEN2]);
-
-  if (!doc[PARAM_SLEEP_INTERVAL].isNull())
-    setSleepInterval(doc[PARAM_SLEEP_INTERVAL].as<int>());
-  if (!doc[PARAM_VOLTAGE_FACTOR].isNull())
-    setVoltageFactor(doc[PARAM_VOLTAGE_FACTOR].as<float>());
-  if (!doc[PARAM_VOLTAGE_CONFIG].isNull())
-    setVoltageConfig(doc[PARAM_VOLTAGE_CONFIG].as<float>());
-  if (!doc[PARAM_GRAVITY_FORMULA].isNull())
-    setGravityFormula(doc[PARAM_GRAVITY_FORMULA]);
-  if (!doc[PARAM_GRAVITY_TEMP_ADJ].isNull())
-    setGravityTempAdj(doc[PARAM_GRAVITY_TEMP_ADJ].as<bool>());
-  if (!doc[PARAM_GYRO_TEMP].isNull())
-    setGyroTemp(doc[PARAM_GYRO_TEMP].as<bool>());
-  if (!doc[PARAM_STORAGE_SLEEP].isNull())
-    setStorageSleep(doc[PARAM_STORAGE_SLEEP].as<bool>());
-  if (!doc[PARAM_GRAVITY_FORMAT].isNull()) {
-    String s = doc[PARAM_GRAVITY_FORMAT];
-    setGravityFormat(s.charAt(0));
-  }
-  if (!doc[PARAM_GYRO_DISABLED].isNull())
-    setGyroDisabled(doc[PARAM_GYRO_DISABLED].as<bool>());
-  if (!doc[PARAM_TEMP_ADJ].isNull())
-    setTempSensorAdjC(doc[PARAM_TEMP_ADJ].as<float>());
-  if (!doc[PARAM_SKIP_SSL_ON_TEST].isNull())
-    setSkipSslOnTest(doc[PARAM_SKIP_SSL_ON_TEST].as<bool>());
-  if (!doc[PARAM_VOLTAGE_PIN].isNull())
-    setVoltagePin(doc[PARAM_VOLTAGE_PIN].as<int>());
-
-  if (!doc[PARAM_GYRO_CALIBRATION]["ax"].isNull())
-    _gyroCalibration.ax = doc[PARAM_GYRO_CALIBRATION]["ax"];
-  if (!doc[PARAM_GYRO_CALIBRATION]["ay"].isNull())
-    _gyroCalibration.ay = doc[PARAM_GYRO_CALIBRATION]["ay"];
-  if (!doc[PARAM_GYRO_CALIBRATION]["az"].isNull())
-    _gyroCalibration.az = doc[PARAM_GYRO_CALIBRATION]["az"];
-  if (!doc[PARAM_GYRO_CALIBRATION]["gx"].isNull())
-    _gyroCalibration.gx = doc[PARAM_GYRO_CALIBRATION]["gx"];
-  if (!doc[PARAM_GYRO_CALIBRATION]["gy"].isNull())
-    _gyroCalibration.gy = doc[PARAM_GYRO_CALIBRATION]["gy"];
-  if (!doc[PARAM_GYRO_CALIBRATION]["gz"].isNull())
-    _gyroCalibration.gz = doc[PARAM_GYRO_CALIBRATION]["gz"];
-
-  if (!doc[PARAM_FORMULA_DATA].isNull()) {
-    JsonArray array = doc[PARAM_FORMULA_DATA].as<JsonArray>();
-    int i = 0;
-
-    for (JsonVariant v : array) {
-      _formulaData.a[i] = v["a"].as<double>();
-      _formulaData.g[i] = v["g"].as<double>();
-      i++;
-    }
+  // One pass over the document, keys not in the table belong to the base
+  ConfigField f;
 
-    if (i != FORMULA_DATA_SIZE) {
-      Log.warning(F("Size of formula array is not as expected (%d)" CR), i);
-    }
-  }
+  for (JsonPair kv : doc) {
+    if (kv.value().isNull()) continue;
 
-  if (!doc[PARAM_GYRO_READ_COUNT].isNull())
-    this->setGyroReadCount(doc[PARAM_GYRO_READ_COUNT].as<int>());
-  // if (!doc[PARAM_GYRO_READ_DELAY].isNull())
-  //  this->setGyroReadDelay(doc[PARAM_GYRO_READ_DELAY].as<int>());
-  if (!doc[PARAM_GYRO_MOVING_THREASHOLD].isNull())
-    this->setGyroSensorMovingThreashold(
-        doc[PARAM_GYRO_MOVING_THREASHOLD].as<int>());
-  if (!doc[PARAM_FORMULA_DEVIATION].isNull())
-    this->setMaxFormulaCreationDeviation(
-        doc[PARAM_FORMULA_DEVIATION].as<float>());
-  if (!doc[PARAM_FORMULA_CALIBRATION_TEMP].isNull())
-    this->SetDefaultCalibrationTemp(
-        doc[PARAM_FORMULA_CALIBRATION_TEMP].as<float>());
-  if (!doc[PARAM_PUSH_INTERVAL_POST].isNull())
-    this->setPushIntervalPost(doc[PARAM_PUSH_INTERVAL_POST].as<int>());
-  if (!doc[PARAM_PUSH_INTERVAL_POST2].isNull())
-    this->setPushIntervalPost2(doc[PARAM_PUSH_INTERVAL_POST2].as<int>());
-  if (!doc[PARAM_PUSH_INTERVAL_GET].isNull())
-    this->setPushIntervalGet(doc[PARAM_PUSH_INTERVAL_GET].as<int>());
-  if (!doc[PARAM_PUSH_INTERVAL_INFLUX].isNull())
-    this->setPushIntervalInflux(doc[PARAM_PUSH_INTERVAL_INFLUX].as<int>());
-  if (!doc[PARAM_PUSH_INTERVAL_MQTT].isNull())
-    this->setPushIntervalMqtt(doc[PARAM_PUSH_INTERVAL_MQTT].as<int>());
-  if (!doc[PARAM_TEMPSENSOR_RESOLUTION].isNull())
-    this->setTempSensorResolution(doc[PARAM_TEMPSENSOR_RESOLUTION].as<int>());
-  if (!doc[PARAM_IGNORE_LOW_ANGLES].isNull())
-    setIgnoreLowAnges(doc[PARAM_IGNORE_LOW_ANGLES].as<bool>());
-  if (!doc[PARAM_BATTERY_SAVING].isNull())
-    setBatterySaving(doc[PARAM_BATTERY_SAVING].as<bool>());
+    if (ConfigFieldTable::find(kv.key().c_str(), f)) parseField(f, kv.value());
+  }
 }
 
 void GravmonConfig::migrateSettings() {
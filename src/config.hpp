@@ -49,6 +49,16 @@ struct RawGyroData {
   int16_t temp;  // Only for information (temperature of chip)
 };
 
+// Per axis accelerometer correction, applied as (raw - offset) * scale
+struct AccelScaleData {
+  float ox;
+  float oy;
+  float oz;
+  float sx;
+  float sy;
+  float sz;
+};
+
 // Used for holding formulaData (used for calculating formula on device)
 #define FORMULA_DATA_SIZE 10
 
@@ -57,9 +67,165 @@ struct RawFormulaData {
   double g[FORMULA_DATA_SIZE];
 };
 
+// String settings are kept in one fixed block owned by the config object,
+// each with a fixed capacity, so updating them never allocates from the heap.
+enum ConfigStringSlot : uint8_t {
+  CFG_STR_TOKEN = 0,
+  CFG_STR_TOKEN2,
+  CFG_STR_GRAVITY_FORMULA,
+  CFG_STR_BLE_TILT_COLOR,
+  CFG_STR_FINGERPRINT_POST,  // Server certificate of https targets
+  CFG_STR_FINGERPRINT_POST2,
+  CFG_STR_FINGERPRINT_GET,
+  CFG_STR_FINGERPRINT_INFLUX,
+  CFG_STR_SLOTS
+};
+
+// Certificate fingerprints are SHA1 on the esp8266 (BearSSL) and SHA256 on
+// the esp32 (mbedtls), as hex digits optionally separated by ':' or ' '.
+#if defined(ESP8266)
+constexpr auto TLS_FINGERPRINT_DIGITS = 40;
+#else
+constexpr auto TLS_FINGERPRINT_DIGITS = 64;
+#endif
+constexpr auto TLS_FINGERPRINT_CHARS = TLS_FINGERPRINT_DIGITS / 2 * 3 - 1;
+
+// Max length for each slot, excluding the terminator
+constexpr uint16_t configStringCapacity(uint8_t slot) {
+  return slot == CFG_STR_TOKEN || slot == CFG_STR_TOKEN2 ? 120
+         : slot == CFG_STR_GRAVITY_FORMULA               ? 200
+         : slot == CFG_STR_BLE_TILT_COLOR                ? 20
+         : slot < CFG_STR_SLOTS                          ? TLS_FINGERPRINT_CHARS
+                                                         : 0;
+}
+
+constexpr uint16_t configStringOffset(uint8_t slot) {
+  return slot == 0 ? 0
+                   : configStringOffset(slot - 1) +
+                         configStringCapacity(slot - 1) + 1;
+}
+
+class ConfigStrings {
+ private:
+  char _data[configStringOffset(CFG_STR_SLOTS)] = {};
+
+ public:
+  const char* get(uint8_t slot) const {
+    return &_data[configStringOffset(slot)];
+  }
+  bool set(uint8_t slot, const char* s);  // False if value was truncated
+};
+
+class GravmonConfig;
+
+// FNV-1a, usable both at compile time (field table) and at runtime (lookup)
+constexpr uint32_t configKeyHash(const char* s, uint32_t h = 2166136261u) {
+  return *s ? configKeyHash(s + 1, (h ^ static_cast<uint8_t>(*s)) * 16777619u)
+            : h;
+}
+
+enum class ConfigFieldType : uint8_t { Bool, Int, Float, Char, Text, Custom };
+
+// One entry in the config field table (see config.cpp), describes where a
+// json key is stored and how it is converted. Values that are not a plain
+// member (nested objects, enums) use a custom reader/writer pair.
+struct ConfigField {
+  typedef bool (*Validator)(JsonVariantConst v);
+  typedef void (*Reader)(GravmonConfig& cfg, JsonVariantConst v);
+  typedef void (*Writer)(GravmonConfig& cfg, JsonObject& doc, const char* key);
+
+  struct CustomIo {
+    Reader read;
+    Writer write;
+  };
+
+  union Target {
+    bool GravmonConfig::*b;
+    int GravmonConfig::*i;
+    float GravmonConfig::*f;
+    char GravmonConfig::*c;
+    ConfigStringSlot s;
+    CustomIo io;
+
+    constexpr Target() : io{nullptr, nullptr} {}
+    constexpr Target(bool GravmonConfig::*p) : b(p) {}
+    constexpr Target(int GravmonConfig::*p) : i(p) {}
+    constexpr Target(float GravmonConfig::*p) : f(p) {}
+    constexpr Target(char GravmonConfig::*p) : c(p) {}
+    constexpr Target(ConfigStringSlot p) : s(p) {}
+    constexpr Target(Reader r, Writer w) : io{r, w} {}
+  };
+
+  const char* key;
+  uint32_t hash;
+  ConfigFieldType type;
+  uint8_t decimals;  // Float only, 0 = write the value as is
+  Target target;
+  Validator validator;  // Optional, value is ignored if it returns false
+
+  constexpr ConfigField()
+      : key(nullptr),
+        hash(0),
+        type(ConfigFieldType::Custom),
+        decimals(0),
+        target(),
+        validator(nullptr) {}
+  constexpr ConfigField(const char* k, bool GravmonConfig::*p,
+                        Validator v = nullptr)
+      : key(k),
+        hash(configKeyHash(k)),
+        type(ConfigFieldType::Bool),
+        decimals(0),
+        target(p),
+        validator(v) {}
+  constexpr ConfigField(const char* k, int GravmonConfig::*p,
+                        Validator v = nullptr)
+      : key(k),
+        hash(configKeyHash(k)),
+        type(ConfigFieldType::Int),
+        decimals(0),
+        target(p),
+        validator(v) {}
+  constexpr ConfigField(const char* k, float GravmonConfig::*p,
+                        uint8_t d = 0, Validator v = nullptr)
+      : key(k),
+        hash(configKeyHash(k)),
+        type(ConfigFieldType::Float),
+        decimals(d),
+        target(p),
+        validator(v) {}
+  constexpr ConfigField(const char* k, char GravmonConfig::*p,
+                        Validator v = nullptr)
+      : key(k),
+        hash(configKeyHash(k)),
+        type(ConfigFieldType::Char),
+        decimals(0),
+        target(p),
+        validator(v) {}
+  constexpr ConfigField(const char* k, ConfigStringSlot p,
+                        Validator v = nullptr)
+      : key(k),
+        hash(configKeyHash(k)),
+        type(ConfigFieldType::Text),
+        decimals(0),
+        target(p),
+        validator(v) {}
+  constexpr ConfigField(const char* k, Reader r, Writer w,
+                        Validator v = nullptr)
+      : key(k),
+        hash(configKeyHash(k)),
+        type(ConfigFieldType::Custom),
+        decimals(0),
+        target(r, w),
+        validator(v) {}
+};
+
 class GravmonConfig : public BaseConfig {
  private:
+  friend struct ConfigFieldTable;
+
   int _configVersion = 2;
+  String _configFile;
 
   // Device configuration
 #if defined(ESP8266)
@@ -94,21 +260,19 @@ class GravmonConfig : public BaseConfig {
 
   bool _wifiDirect = false;
 
-  // Push target settings
-  String _token = "";
-  String _token2 = "";
+  // Token, gravity formula and ble color
+  ConfigStrings _strings;
 
   // Gravity and temperature calculations
-  String _gravityFormula = "";
   bool _gravityTempAdj = false;
   char _gravityFormat = 'G';
 
   // BLE (ESP32 only)
-  String _bleTiltColor;
   BleFormat _bleFormat = BleFormat::BLE_DISABLED;
 
   // Gyro calibration and formula calculation data
   RawGyroData _gyroCalibration = {0, 0, 0, 0, 0, 0};
+  AccelScaleData _accelScale = {0, 0, 0, 1, 1, 1};
   RawFormulaData _formulaData = {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
                                  {1, 1, 1, 1, 1, 1, 1, 1, 1, 1}};
 
@@ -130,8 +294,21 @@ class GravmonConfig : public BaseConfig {
   bool _batterySaving = true;
 #endif
   bool _darkMode = false;
+  float _pushDeadbandGravity = 0;  // SG, 0 = disabled
+  float _pushDeadbandTemp = 0;     // C
+  int _pushMaxSilence = 3600;      // seconds
+  bool _sleepAdaptive = false;
+  bool _gravityFilter = false;
+  bool _gravityLookup = false;
+  bool _gyroFusion = false;
+  int _gyroStillTime = 10;  // seconds
+  int _sleepIntervalMin = 300;   // seconds
+  int _sleepIntervalMax = 3600;  // seconds
 
   void formatFileSystem();
+  void createField(const ConfigField& f, JsonObject& doc);
+  void parseField(const ConfigField& f, JsonVariantConst v);
+  uint32_t fileHash();
 
  public:
   GravmonConfig(String baseMDNS, String fileName);
@@ -166,14 +343,14 @@ class GravmonConfig : public BaseConfig {
   }
 
   // Token parameter
-  const char* getToken() { return _token.c_str(); }
-  void setToken(String s) {
-    _token = s;
+  const char* getToken() { return _strings.get(CFG_STR_TOKEN); }
+  void setToken(const char* s) {
+    _strings.set(CFG_STR_TOKEN, s);
     _saveNeeded = true;
   }
-  const char* getToken2() { return _token2.c_str(); }
-  void setToken2(String s) {
-    _token2 = s;
+  const char* getToken2() { return _strings.get(CFG_STR_TOKEN2); }
+  void setToken2(const char* s) {
+    _strings.set(CFG_STR_TOKEN2, s);
     _saveNeeded = true;
   }
 
@@ -233,9 +410,11 @@ class GravmonConfig : public BaseConfig {
     _saveNeeded = true;
   }
 
-  const char* getGravityFormula() { return _gravityFormula.c_str(); }
-  void setGravityFormula(String s) {
-    _gravityFormula = s;
+  const char* getGravityFormula() {
+    return _strings.get(CFG_STR_GRAVITY_FORMULA);
+  }
+  void setGravityFormula(const char* s) {
+    _strings.set(CFG_STR_GRAVITY_FORMULA, s);
     _saveNeeded = true;
   }
 
@@ -255,9 +434,9 @@ class GravmonConfig : public BaseConfig {
   bool isGravitySG() { return _gravityFormat == 'G'; }
   bool isGravityPlato() { return _gravityFormat == 'P'; }
 
-  const char* getBleTiltColor() { return _bleTiltColor.c_str(); }
-  void setBleTiltColor(String c) {
-    _bleTiltColor = c;
+  const char* getBleTiltColor() { return _strings.get(CFG_STR_BLE_TILT_COLOR); }
+  void setBleTiltColor(const char* c) {
+    _strings.set(CFG_STR_BLE_TILT_COLOR, c);
     _saveNeeded = true;
   }
   bool isBleActive() { return (_bleFormat != BleFormat::BLE_DISABLED); }
@@ -268,6 +447,36 @@ class GravmonConfig : public BaseConfig {
                : false;
   }
 
+  // Certificate pinning for https targets, empty means no validation
+  const char* getHttpPostFingerprint() {
+    return _strings.get(CFG_STR_FINGERPRINT_POST);
+  }
+  void setHttpPostFingerprint(const char* s) {
+    _strings.set(CFG_STR_FINGERPRINT_POST, s);
+    _saveNeeded = true;
+  }
+  const char* getHttpPost2Fingerprint() {
+    return _strings.get(CFG_STR_FINGERPRINT_POST2);
+  }
+  void setHttpPost2Fingerprint(const char* s) {
+    _strings.set(CFG_STR_FINGERPRINT_POST2, s);
+    _saveNeeded = true;
+  }
+  const char* getHttpGetFingerprint() {
+    return _strings.get(CFG_STR_FINGERPRINT_GET);
+  }
+  void setHttpGetFingerprint(const char* s) {
+    _strings.set(CFG_STR_FINGERPRINT_GET, s);
+    _saveNeeded = true;
+  }
+  const char* getInfluxDb2Fingerprint() {
+    return _strings.get(CFG_STR_FINGERPRINT_INFLUX);
+  }
+  void setInfluxDb2Fingerprint(const char* s) {
+    _strings.set(CFG_STR_FINGERPRINT_INFLUX, s);
+    _saveNeeded = true;
+  }
+
   const BleFormat getBleFormat() { return _bleFormat; }
   void setBleFormat(int b) {
     _bleFormat = (BleFormat)b;
@@ -292,6 +501,17 @@ class GravmonConfig : public BaseConfig {
                : true;
   }
 
+  const AccelScaleData& getAccelScale() { return _accelScale; }
+  void setAccelScale(const AccelScaleData& s) {
+    _accelScale = s;
+    _saveNeeded = true;
+  }
+
+  bool hasAccelScale() {
+    return _accelScale.ox || _accelScale.oy || _accelScale.oz ||
+           _accelScale.sx != 1 || _accelScale.sy != 1 || _accelScale.sz != 1;
+  }
+
   const RawFormulaData& getFormulaData() { return _formulaData; }
   void setFormulaData(const RawFormulaData& r) {
     _formulaData = r;
@@ -324,6 +544,18 @@ class GravmonConfig : public BaseConfig {
     _saveNeeded = true;
   }
 
+  const bool isGyroFusion() { return _gyroFusion; }
+  void setGyroFusion(bool b) {
+    _gyroFusion = b;
+    _saveNeeded = true;
+  }
+
+  int getGyroStillTime() { return _gyroStillTime; }
+  void setGyroStillTime(int t) {
+    _gyroStillTime = t;
+    _saveNeeded = true;
+  }
+
   int getGyroReadCount() { return _gyroReadCount; }
   void setGyroReadCount(int c) {
     _gyroReadCount = c;
@@ -391,9 +623,61 @@ class GravmonConfig : public BaseConfig {
     _saveNeeded = true;
   }
 
+  float getPushDeadbandGravity() { return _pushDeadbandGravity; }
+  void setPushDeadbandGravity(float f) {
+    _pushDeadbandGravity = f;
+    _saveNeeded = true;
+  }
+
+  float getPushDeadbandTemp() { return _pushDeadbandTemp; }
+  void setPushDeadbandTemp(float f) {
+    _pushDeadbandTemp = f;
+    _saveNeeded = true;
+  }
+
+  int getPushMaxSilence() { return _pushMaxSilence; }
+  void setPushMaxSilence(int t) {
+    _pushMaxSilence = t;
+    _saveNeeded = true;
+  }
+
+  bool isPushDeadbandActive() { return _pushDeadbandGravity > 0; }
+
+  const bool isSleepAdaptive() { return _sleepAdaptive; }
+  void setSleepAdaptive(bool b) {
+    _sleepAdaptive = b;
+    _saveNeeded = true;
+  }
+
+  const bool isGravityFilter() { return _gravityFilter; }
+  void setGravityFilter(bool b) {
+    _gravityFilter = b;
+    _saveNeeded = true;
+  }
+
+  const bool isGravityLookup() { return _gravityLookup; }
+  void setGravityLookup(bool b) {
+    _gravityLookup = b;
+    _saveNeeded = true;
+  }
+
+  int getSleepIntervalMin() { return _sleepIntervalMin; }
+  void setSleepIntervalMin(int v) {
+    _sleepIntervalMin = v;
+    _saveNeeded = true;
+  }
+
+  int getSleepIntervalMax() { return _sleepIntervalMax; }
+  void setSleepIntervalMax(int v) {
+    _sleepIntervalMax = v;
+    _saveNeeded = true;
+  }
+
   // IO functions
   void createJson(JsonObject& doc);
   void parseJson(JsonObject& doc);
+  bool saveFile() override { return saveFile(nullptr); }
+  bool saveFile(bool* written);
   void migrateSettings();
   void migrateHwSettings();
 };
@@ -0,0 +1,105 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <lwip/tcp.h>
+
+#include <conntrace.hpp>
+
+ConnTrace myConnTrace;
+
+void ConnTrace::begin() {
+  _pcb = nullptr;
+  _lookup = _dns = 0;
+  _connect = _connected = 0;
+  _lastRx = _lastTx = _rxBeforeTx = 0;
+  _active = true;
+}
+
+void ConnTrace::end() { _active = false; }
+
+void ConnTrace::lookup() {
+  if (_active) _lookup = millis();
+}
+
+// A new connection replaces the traced one, a retry or a connection that
+// validates the certificate before the push is not part of the result.
+void ConnTrace::connect(const void* pcb) {
+  if (!_active) return;
+
+  uint32_t now = millis();
+
+  _dns = _lookup ? now - _lookup : 0;
+  _lookup = 0;
+  _pcb = pcb;
+  _connect = now;
+  _connected = _lastRx = _lastTx = _rxBeforeTx = 0;
+}
+
+// The client writes as soon as the connection is open, a http request or the
+// first tls handshake message.
+void ConnTrace::sent(const void* pcb) {
+  if (!_active || pcb != _pcb) return;
+
+  uint32_t now = millis();
+
+  if (!_connected) _connected = now;
+
+  _lastTx = now;
+  _rxBeforeTx = _lastRx;
+}
+
+void ConnTrace::received(const void* pcb) {
+  if (_active && pcb == _pcb) _lastRx = millis();
+}
+
+// The last handshake message is the last data read before the request
+uint32_t ConnTrace::handshakeEnd(bool secure) {
+  return secure && _rxBeforeTx > _connected ? _rxBeforeTx : _connected;
+}
+
+extern "C" {
+err_t __real_tcp_connect(struct tcp_pcb* pcb, const ip_addr_t* ipaddr,
+                         u16_t port, tcp_connected_fn connected);
+err_t __real_tcp_write(struct tcp_pcb* pcb, const void* dataptr, u16_t len,
+                       u8_t apiflags);
+void __real_tcp_recved(struct tcp_pcb* pcb, u16_t len);
+
+err_t __wrap_tcp_connect(struct tcp_pcb* pcb, const ip_addr_t* ipaddr,
+                         u16_t port, tcp_connected_fn connected) {
+  myConnTrace.connect(pcb);
+  return __real_tcp_connect(pcb, ipaddr, port, connected);
+}
+
+err_t __wrap_tcp_write(struct tcp_pcb* pcb, const void* dataptr, u16_t len,
+                       u8_t apiflags) {
+  myConnTrace.sent(pcb);
+  return __real_tcp_write(pcb, dataptr, len, apiflags);
+}
+
+void __wrap_tcp_recved(struct tcp_pcb* pcb, u16_t len) {
+  myConnTrace.received(pcb);
+  __real_tcp_recved(pcb, len);
+}
+}
+
+// EOF
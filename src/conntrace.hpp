@@ -0,0 +1,77 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_CONNTRACE_HPP_
+#define SRC_CONNTRACE_HPP_
+
+#include <Arduino.h>
+
+// Takes the timestamps of an outgoing connection from the lwip calls made by
+// the client that does the push, so no extra connection is needed to time
+// it. The lwip functions are routed through the hooks in conntrace.cpp by the
+// linker (see platformio.ini);
+// -Wl,--wrap=tcp_connect,--wrap=tcp_write,--wrap=tcp_recved
+//
+// Only the last connection opened between begin() and end() is traced, the
+// connections of the web server are ignored. The name lookup is reported by
+// the dns hooks in dnscache.cpp.
+class ConnTrace {
+ private:
+  volatile bool _active = false;
+  const void* volatile _pcb = nullptr;
+  volatile uint32_t _lookup = 0;      // Last name lookup started
+  volatile uint32_t _dns = 0;         // Lookup time of the traced connection
+  volatile uint32_t _connect = 0;     // Connection requested
+  volatile uint32_t _connected = 0;   // First data written
+  volatile uint32_t _lastRx = 0;      // Last data read
+  volatile uint32_t _lastTx = 0;      // Last data written
+  volatile uint32_t _rxBeforeTx = 0;  // Last data read before _lastTx
+
+  uint32_t handshakeEnd(bool secure);
+
+ public:
+  void begin();
+  void end();
+
+  void lookup();
+  void connect(const void* pcb);
+  void sent(const void* pcb);
+  void received(const void* pcb);
+
+  // The phases in ms, a secure connection counts the data exchanged before
+  // the request as the tls handshake.
+  bool isTraced() { return _connected != 0; }
+  uint32_t getDnsTime() { return _dns; }
+  uint32_t getConnectTime() { return _connected - _connect; }
+  uint32_t getTlsTime(bool secure) { return handshakeEnd(secure) - _connected; }
+  uint32_t getRequestTime(bool secure) {
+    return _lastTx - handshakeEnd(secure);
+  }
+  uint32_t getResponseTime(uint32_t end) { return end - _lastTx; }
+};
+
+extern ConnTrace myConnTrace;
+
+#endif  // SRC_CONNTRACE_HPP_
+
+// EOF
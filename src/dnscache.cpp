@@ -0,0 +1,185 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <lwip/dns.h>
+
+#include <conntrace.hpp>
+#include <dnscache.hpp>
+#include <log.hpp>
+#include <rtcmem.hpp>
+
+DnsCache myDnsCache;
+
+// Host names are case insensitive
+static uint32_t dnsKey(const char* host) {
+  uint32_t h = 2166136261u;
+
+  for (const char* p = host; *p; p++) h = (h ^ tolower(*p)) * 16777619u;
+
+  return h ? h : 1;
+}
+
+void DnsCache::begin(bool useCache) {
+  _active = true;
+  _useCache = useCache;
+  _hitKey = 0;
+}
+
+void DnsCache::end() {
+  _active = false;
+  _hitKey = 0;
+}
+
+bool DnsCache::find(const char* host, uint32_t& ip) {
+  uint32_t key = dnsKey(host);
+
+  if (!_active || !_useCache || !myRtcMemory.findDnsEntry(key, ip))
+    return false;
+
+  _hitKey = key;
+  Log.notice(F("DNS : Using cached address for %s." CR), host);
+  return true;
+}
+
+void DnsCache::store(const char* host, uint32_t ip) {
+  myRtcMemory.storeDnsEntry(dnsKey(host), ip, PUSH_DNS_TTL);
+}
+
+// Called when a connection to the cached address failed
+void DnsCache::removeHit() {
+  myRtcMemory.removeDnsEntry(_hitKey);
+  _hitKey = 0;
+}
+
+// The callback of a lookup that is waiting for the dns server, the result is
+// stored before it is passed on.
+struct PendingLookup {
+  dns_found_callback found;
+  void* arg;
+};
+
+static PendingLookup pendingLookups[DNS_MAX_PENDING];
+
+static void lookupDone(const char* name, const ip_addr_t* addr, void* arg) {
+  PendingLookup* p = static_cast<PendingLookup*>(arg);
+  dns_found_callback found = p->found;
+
+  if (addr && IP_IS_V4(addr))
+    myDnsCache.store(name, ip4_addr_get_u32(ip_2_ip4(addr)));
+
+  p->found = nullptr;
+  found(name, addr, p->arg);
+}
+
+// Returns a slot for a lookup that should be cached, literal addresses and
+// lookups outside a push are not.
+static PendingLookup* beginLookup(const char* hostname,
+                                  dns_found_callback found, void* arg) {
+  ip_addr_t literal;
+
+  if (!myDnsCache.isActive() || ipaddr_aton(hostname, &literal))
+    return nullptr;
+
+  for (auto& p : pendingLookups) {
+    if (!p.found) {
+      p.found = found;
+      p.arg = arg;
+      return &p;
+    }
+  }
+
+  return nullptr;
+}
+
+static err_t endLookup(PendingLookup* p, err_t err, const char* hostname,
+                       const ip_addr_t* addr) {
+  if (p && err != ERR_INPROGRESS) {
+    // Answered by lwip without a callback
+    if (err == ERR_OK && IP_IS_V4(addr))
+      myDnsCache.store(hostname, ip4_addr_get_u32(ip_2_ip4(addr)));
+
+    p->found = nullptr;
+  }
+
+  return err;
+}
+
+static bool findCached(const char* hostname, ip_addr_t* addr) {
+  uint32_t ip;
+
+  if (!myDnsCache.find(hostname, ip)) return false;
+
+  ip_addr_set_ip4_u32(addr, ip);
+  return true;
+}
+
+extern "C" {
+err_t __real_dns_gethostbyname(const char* hostname, ip_addr_t* addr,
+                               dns_found_callback found, void* arg);
+err_t __real_dns_gethostbyname_addrtype(const char* hostname, ip_addr_t* addr,
+                                        dns_found_callback found, void* arg,
+                                        u8_t addrtype);
+
+err_t __wrap_dns_gethostbyname(const char* hostname, ip_addr_t* addr,
+                               dns_found_callback found, void* arg) {
+  myConnTrace.lookup();
+
+  if (findCached(hostname, addr)) return ERR_OK;
+
+  PendingLookup* p = beginLookup(hostname, found, arg);
+
+  if (!p) return __real_dns_gethostbyname(hostname, addr, found, arg);
+
+  return endLookup(
+      p, __real_dns_gethostbyname(hostname, addr, &lookupDone, p), hostname,
+      addr);
+}
+
+err_t __wrap_dns_gethostbyname_addrtype(const char* hostname, ip_addr_t* addr,
+                                        dns_found_callback found, void* arg,
+                                        u8_t addrtype) {
+  myConnTrace.lookup();
+
+#if LWIP_IPV4 && LWIP_IPV6
+  // Only ipv4 addresses are cached
+  if (addrtype == LWIP_DNS_ADDRTYPE_IPV6)
+    return __real_dns_gethostbyname_addrtype(hostname, addr, found, arg,
+                                             addrtype);
+#endif
+
+  if (findCached(hostname, addr)) return ERR_OK;
+
+  PendingLookup* p = beginLookup(hostname, found, arg);
+
+  if (!p)
+    return __real_dns_gethostbyname_addrtype(hostname, addr, found, arg,
+                                             addrtype);
+
+  return endLookup(p,
+                   __real_dns_gethostbyname_addrtype(hostname, addr,
+                                                     &lookupDone, p, addrtype),
+                   hostname, addr);
+}
+}
+
+// EOF
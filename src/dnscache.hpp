@@ -0,0 +1,61 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_DNSCACHE_HPP_
+#define SRC_DNSCACHE_HPP_
+
+#include <Arduino.h>
+
+constexpr auto PUSH_DNS_TTL = 3600;  // seconds
+constexpr auto DNS_MAX_PENDING = 2;
+
+// Keeps the addresses of the push targets in RTC memory so that a wake cycle
+// can skip the name lookup. The lwip lookup functions are routed through the
+// hooks in dnscache.cpp by the linker (see platformio.ini);
+// -Wl,--wrap=dns_gethostbyname,--wrap=dns_gethostbyname_addrtype
+//
+// The hooks only use the cache between begin() and end(), all other lookups
+// are passed on to lwip as is.
+class DnsCache {
+ private:
+  bool _active = false;
+  bool _useCache = false;
+  uint32_t _hitKey = 0;  // Entry that answered the last lookup
+
+ public:
+  void begin(bool useCache = true);
+  void end();
+
+  bool find(const char* host, uint32_t& ip);
+  void store(const char* host, uint32_t ip);
+
+  bool isActive() { return _active; }
+  bool isHit() { return _hitKey != 0; }
+  void removeHit();
+};
+
+extern DnsCache myDnsCache;
+
+#endif  // SRC_DNSCACHE_HPP_
+
+// EOF
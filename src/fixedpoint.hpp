@@ -0,0 +1,120 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_FIXEDPOINT_HPP_
+#define SRC_FIXEDPOINT_HPP_
+
+#include <stdint.h>
+
+// Signed fixed point value in Q(31-F).F format stored in 32 bits, products and
+// quotients use 64 bit intermediates. Used instead of float on platforms
+// without a FPU when ENABLE_FIXED_POINT is defined.
+template <int F>
+struct Fixed {
+  static constexpr int32_t ONE = static_cast<int32_t>(1) << F;
+
+  int32_t raw;
+
+  static constexpr Fixed fromRaw(int32_t r) { return Fixed{r}; }
+  static constexpr Fixed fromInt(int32_t i) { return Fixed{i * ONE}; }
+  static constexpr Fixed fromDouble(double d) {
+    return Fixed{static_cast<int32_t>(d * ONE + (d < 0 ? -0.5 : 0.5))};
+  }
+
+  constexpr double toDouble() const { return static_cast<double>(raw) / ONE; }
+  constexpr float toFloat() const { return static_cast<float>(raw) / ONE; }
+
+  template <int G>
+  constexpr Fixed<G> convert() const {
+    return Fixed<G>{static_cast<int32_t>(
+        (static_cast<int64_t>(raw) << (G > F ? G - F : 0)) >>
+        (F > G ? F - G : 0))};
+  }
+
+  constexpr Fixed operator+(Fixed o) const { return Fixed{raw + o.raw}; }
+  constexpr Fixed operator-(Fixed o) const { return Fixed{raw - o.raw}; }
+  constexpr Fixed operator-() const { return Fixed{-raw}; }
+  constexpr Fixed operator*(Fixed o) const {
+    return Fixed{static_cast<int32_t>(
+        (static_cast<int64_t>(raw) * o.raw + (ONE >> 1)) >> F)};
+  }
+  constexpr Fixed operator/(Fixed o) const {
+    return Fixed{static_cast<int32_t>(static_cast<int64_t>(raw) * ONE / o.raw)};
+  }
+  constexpr bool operator<(Fixed o) const { return raw < o.raw; }
+  constexpr bool operator>(Fixed o) const { return raw > o.raw; }
+};
+
+inline uint32_t fixedIntSqrt(uint64_t v) {
+  uint64_t r = 0;
+  uint64_t b = static_cast<uint64_t>(1) << 62;
+
+  while (b > v) b >>= 2;
+
+  while (b) {
+    if (v >= r + b) {
+      v -= r + b;
+      r = (r >> 1) + b;
+    } else {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+
+  return static_cast<uint32_t>(r);
+}
+
+template <int F>
+Fixed<F> fixedSqrt(Fixed<F> x) {
+  if (x.raw <= 0) return Fixed<F>{0};
+  return Fixed<F>{static_cast<int32_t>(
+      fixedIntSqrt(static_cast<uint64_t>(x.raw) << F))};
+}
+
+// Evaluate c[0] + c[1]*x + ... + c[N-1]*x^(N-1) using Horner's method.
+template <int F, int N>
+Fixed<F> fixedPolynomial(const Fixed<F> (&c)[N], Fixed<F> x) {
+  Fixed<F> v = c[N - 1];
+  for (int k = N - 2; k >= 0; k--) v = v * x + c[k];
+  return v;
+}
+
+// Arccos in radians for x in 0..1, the error is less than 2e-8 rad plus the
+// rounding in Q format. Source: Abramowitz and Stegun 4.4.46
+template <int F>
+Fixed<F> fixedAcos(Fixed<F> x) {
+  static const Fixed<F> c[] = {
+      Fixed<F>::fromDouble(1.5707963050),  Fixed<F>::fromDouble(-0.2145988016),
+      Fixed<F>::fromDouble(0.0889789874),  Fixed<F>::fromDouble(-0.0501743046),
+      Fixed<F>::fromDouble(0.0308918810),  Fixed<F>::fromDouble(-0.0170881256),
+      Fixed<F>::fromDouble(0.0066700901),  Fixed<F>::fromDouble(-0.0012624911)};
+
+  if (x.raw < 0) x.raw = 0;
+  if (x.raw > Fixed<F>::ONE) x.raw = Fixed<F>::ONE;
+
+  return fixedSqrt(Fixed<F>::fromInt(1) - x) * fixedPolynomial(c, x);
+}
+
+#endif  // SRC_FIXEDPOINT_HPP_
+
+// EOF
@@ -0,0 +1,235 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <LittleFS.h>
+
+#include <calc.hpp>
+#include <calibration.hpp>
+#include <config.hpp>
+#include <gravitytable.hpp>
+#include <log.hpp>
+#include <rtcmem.hpp>
+
+constexpr uint32_t GRAVITY_TABLE_MAGIC = 0x4c425447;  // GTBL
+constexpr auto GRAVITY_TABLE_MIN_ANGLE = 0.0;
+constexpr auto GRAVITY_TABLE_MAX_ANGLE = 90.0;
+
+GravityTable myGravityTable;
+
+static uint32_t hashFormula(const char *formula) {
+  uint32_t h = 2166136261;  // FNV-1a
+
+  while (*formula) {
+    h ^= static_cast<uint8_t>(*formula++);
+    h *= 16777619;
+  }
+
+  return h;
+}
+
+bool GravityTable::readHeader(File &f, GravityTableHeader &h) {
+  return f.read(reinterpret_cast<uint8_t *>(&h), sizeof(h)) == sizeof(h) &&
+         h.magic == GRAVITY_TABLE_MAGIC && h.count >= 2 &&
+         f.size() == sizeof(h) + h.count * sizeof(int32_t);
+}
+
+// Position of the angle in the table, angles outside the table are clamped to
+// the first or last entry.
+static uint32_t tableIndex(const GravityTableWindow &w, float angle,
+                           int32_t &frac) {
+  int32_t a = angle * (1 << GRAVITY_TABLE_ANGLE_BITS) - w.start;
+  int32_t last = (w.count - 1) * w.step;
+
+  if (a < 0 || a > last) {
+#if LOG_LEVEL == 6
+    Log.verbose(F("GTBL: Angle %F is outside the table, clamping." CR), angle);
+#endif
+    a = a < 0 ? 0 : last;
+  }
+
+  uint32_t idx = a / w.step;
+  frac = a % w.step;
+
+  if (idx >= w.count - 1u) {
+    idx = w.count - 2;
+    frac = w.step;
+  }
+
+  return idx;
+}
+
+// The table covers the angles used for creating the formula, if these are not
+// available the full range of angles is used.
+void GravityTable::getAngleRange(float &minAngle, float &maxAngle) {
+  minAngle = GRAVITY_TABLE_MAX_ANGLE;
+  maxAngle = GRAVITY_TABLE_MIN_ANGLE;
+
+  auto update = [&minAngle, &maxAngle](float a) {
+    if (a < minAngle) minAngle = a;
+    if (a > maxAngle) maxAngle = a;
+  };
+
+  if (myCalibrationStore.size()) {
+    myCalibrationStore.forEach(
+        [&update](const CalibrationPoint &p) { update(p.angle); });
+  } else {
+    const RawFormulaData &fd = myConfig.getFormulaData();
+
+    for (int i = 0; i < FORMULA_DATA_SIZE; i++)
+      if (fd.a[i]) update(fd.a[i]);
+  }
+
+  if (minAngle >= maxAngle) {
+    minAngle = GRAVITY_TABLE_MIN_ANGLE;
+    maxAngle = GRAVITY_TABLE_MAX_ANGLE;
+  }
+}
+
+bool GravityTable::create(const char *formula, uint32_t hash) {
+  // A table can only be used if the formula depends on the angle alone
+  if (strstr(formula, "temp")) {
+    Log.notice(F("GTBL: Formula depends on temperature, not using table." CR));
+    LittleFS.remove(GRAVITY_TABLE_FILENAME);
+    return false;
+  }
+
+  float minAngle, maxAngle;
+  getAngleRange(minAngle, maxAngle);
+
+  const int32_t step = GRAVITY_TABLE_STEP * (1 << GRAVITY_TABLE_ANGLE_BITS);
+  const int32_t start = floor(minAngle / GRAVITY_TABLE_STEP) * step;
+  const uint32_t count =
+      ceil(maxAngle / GRAVITY_TABLE_STEP) - start / step + 1;
+
+  File f = LittleFS.open(GRAVITY_TABLE_FILENAME, "w");
+
+  if (!f) return false;
+
+  GravityTableHeader h = {GRAVITY_TABLE_MAGIC, hash, start, step, count};
+  f.write(reinterpret_cast<const uint8_t *>(&h), sizeof(h));
+
+  for (uint32_t i = 0; i < count; i++) {
+    double angle =
+        static_cast<double>(start + static_cast<int32_t>(i) * step) /
+        (1 << GRAVITY_TABLE_ANGLE_BITS);
+    int32_t g = round(calculateGravity(angle, 0, formula) *
+                      (1 << GRAVITY_TABLE_GRAVITY_BITS));
+    f.write(reinterpret_cast<const uint8_t *>(&g), sizeof(g));
+  }
+
+  f.close();
+
+  Log.notice(F("GTBL: Created gravity table with %d entries for angle %F to "
+               "%F." CR),
+             count, minAngle, maxAngle);
+  return true;
+}
+
+// Called when the configuration has been saved, creates the table if the
+// lookup is enabled and the table is missing or made for another formula.
+void GravityTable::update() {
+  if (!myConfig.isGravityLookup()) return;
+
+  const char *formula = myConfig.getGravityFormula();
+  uint32_t hash = hashFormula(formula);
+  GravityTableHeader h;
+  File f = LittleFS.open(GRAVITY_TABLE_FILENAME, "r");
+  bool current = f && readHeader(f, h) && h.formulaHash == hash;
+
+  if (f) f.close();
+
+  if (current || !strlen(formula)) return;
+
+  create(formula, hash);
+  myRtcMemory.getGravityTableWindow().formulaHash = 0;
+}
+
+// Reads the entries around the angle into RTC memory. If there is no table
+// for the formula this is also remembered so we dont try again.
+bool GravityTable::loadWindow(uint32_t hash, float angle) {
+  GravityTableWindow &w = myRtcMemory.getGravityTableWindow();
+  GravityTableHeader h;
+  File f = LittleFS.open(GRAVITY_TABLE_FILENAME, "r");
+
+  w.formulaHash = hash;
+  w.count = 0;
+
+  if (!f) return false;
+
+  bool b = readHeader(f, h) && h.formulaHash == hash;
+
+  if (b) {
+    int32_t frac;
+
+    w.start = h.start;
+    w.step = h.step;
+    w.count = h.count;
+
+    uint32_t idx = tableIndex(w, angle, frac);
+    uint32_t n = h.count < RTC_GRAVITY_TABLE_WINDOW ? h.count
+                                                    : RTC_GRAVITY_TABLE_WINDOW;
+    uint32_t first = idx > n / 2 - 1 ? idx - (n / 2 - 1) : 0;
+
+    if (first + n > h.count) first = h.count - n;
+
+    w.first = first;
+    b = f.seek(sizeof(h) + first * sizeof(int32_t)) &&
+        f.read(reinterpret_cast<uint8_t *>(&w.entry[0]),
+               n * sizeof(int32_t)) == n * sizeof(int32_t);
+  }
+
+  f.close();
+
+  if (!b) w.count = 0;
+
+  return b;
+}
+
+// Returns false if there is no table for the current formula and the formula
+// needs to be used instead.
+bool GravityTable::lookup(float angle, double &gravity) {
+  GravityTableWindow &w = myRtcMemory.getGravityTableWindow();
+  uint32_t hash = hashFormula(myConfig.getGravityFormula());
+  int32_t frac = 0;
+  uint32_t idx = 0;
+
+  if (w.formulaHash == hash) {
+    if (w.count < 2) return false;
+
+    idx = tableIndex(w, angle, frac);
+  }
+
+  if (w.formulaHash != hash || idx < w.first ||
+      idx + 1 >= w.first + RTC_GRAVITY_TABLE_WINDOW) {
+    if (!loadWindow(hash, angle)) return false;
+
+    idx = tableIndex(w, angle, frac);
+  }
+
+  int32_t g0 = w.entry[idx - w.first], g1 = w.entry[idx + 1 - w.first];
+  int32_t v = g0 + static_cast<int64_t>(g1 - g0) * frac / w.step;
+  gravity = static_cast<double>(v) / (1 << GRAVITY_TABLE_GRAVITY_BITS);
+  return true;
+}
+
+// EOF
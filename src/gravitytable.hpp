@@ -0,0 +1,64 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_GRAVITYTABLE_HPP_
+#define SRC_GRAVITYTABLE_HPP_
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+constexpr auto GRAVITY_TABLE_FILENAME = "/gravity.tbl";
+constexpr auto GRAVITY_TABLE_ANGLE_BITS = 16;    // Q15.16 for angles
+constexpr auto GRAVITY_TABLE_GRAVITY_BITS = 20;  // Q11.20 for gravity
+constexpr auto GRAVITY_TABLE_STEP = 0.25;        // Degrees between entries
+
+struct GravityTableHeader {
+  uint32_t magic;
+  uint32_t formulaHash;
+  int32_t start;  // First angle in the table
+  int32_t step;   // Angle between the entries
+  uint32_t count;
+};
+
+// Precalculated table of gravity for the current formula over the calibrated
+// angles, lookup is done with linear interpolation using fixed point math.
+// The table is created when the formula is saved and the entries around the
+// last angle are kept in RTC memory, so most readings are done without
+// accessing the file system.
+class GravityTable {
+ private:
+  bool readHeader(File &f, GravityTableHeader &h);
+  bool create(const char *formula, uint32_t hash);
+  bool loadWindow(uint32_t hash, float angle);
+  void getAngleRange(float &minAngle, float &maxAngle);
+
+ public:
+  void update();
+  bool lookup(float angle, double &gravity);
+};
+
+extern GravityTable myGravityTable;
+
+#endif  // SRC_GRAVITYTABLE_HPP_
+
+// EOF
@@ -27,6 +27,10 @@ SOFTWARE.
 #include <log.hpp>
 #include <main.hpp>
 
+#if defined(ENABLE_MOTION_WAKEUP)
+#include <esp_sleep.h>
+#endif
+
 GyroSensor myGyro;
 MPU6050 accelgyro;
 
@@ -34,6 +38,22 @@ MPU6050 accelgyro;
 #define GYRO_SHOW_MINMAX    // Will calculate the min/max values when doing
                             // calibration
 
+// Sensor fusion, weight of the gyro integration vs the accelerometer and the
+// number of samples averaged to get the starting gravity vector. A reading
+// with movement is used if the rates are within the factor of the moving
+// threashold and the fused angle agrees with the accelerometer (degrees).
+constexpr auto GYRO_FUSION_ALPHA = 0.98;
+constexpr auto GYRO_FUSION_SEED = 10;
+constexpr auto GYRO_FUSION_THREASHOLD_FACTOR = 3;
+constexpr auto GYRO_FUSION_MAX_DEVIATION = 2.0;
+constexpr auto GYRO_RAD_PER_LSB = PI / (180.0 * 131.0);  // +/- 250 deg/s
+
+// Motion detection used for wakeup, threashold is in steps of 2 mg and the
+// zero motion duration is in steps of 64 ms.
+constexpr auto GYRO_MOTION_THREASHOLD = 20;
+constexpr auto GYRO_MOTION_DURATION = 1;  // ms
+constexpr auto GYRO_ZERO_MOTION_THREASHOLD = 4;
+
 uint8_t GyroSensor::getGyroID() { return accelgyro.getDeviceID(); }
 
 bool GyroSensor::setup() {
@@ -92,6 +112,16 @@ bool GyroSensor::setup() {
     accelgyro.setIntDataReadyEnabled(true);
 #endif
 
+#if defined(ENABLE_MOTION_WAKEUP)
+    // Restore normal operation if motion wakeup was used before sleep
+    accelgyro.setWakeCycleEnabled(false);
+    accelgyro.setIntMotionEnabled(false);
+    accelgyro.setIntZeroMotionEnabled(false);
+    accelgyro.setStandbyXGyroEnabled(false);
+    accelgyro.setStandbyYGyroEnabled(false);
+    accelgyro.setStandbyZGyroEnabled(false);
+#endif
+
     // Once we have calibration values stored we just apply them from the
     // config.
     _calibrationOffset = myConfig.getGyroCalibration();
@@ -107,13 +137,81 @@ void GyroSensor::enterSleep() {
 #if defined(FLOATY)
   digitalWrite(PIN_VCC, LOW);
 #else
-  accelgyro.setSleepEnabled(true);
+  // When used as wakeup source the gyro is already in low power cycle mode
+  if (!_motionWakeup) accelgyro.setSleepEnabled(true);
+#endif
+}
+
+// Configure the gyro to signal motion (zeroMotion=false) or that it has been
+// still for the configured time (zeroMotion=true) on the INT pin and use that
+// as wakeup source for deep sleep. The gyro is put in low power cycle mode
+// where only the accelerometer is sampled.
+void GyroSensor::enableMotionWakeup(bool zeroMotion) {
+#if defined(ENABLE_MOTION_WAKEUP)
+  if (!_sensorConnected) return;
+
+  int duration = myConfig.getGyroStillTime() * 1000 / 64;
+
+  Log.notice(F("GYRO: Enable wakeup on %s." CR),
+             zeroMotion ? "zero motion" : "motion");
+
+  accelgyro.setIntDataReadyEnabled(false);
+  accelgyro.setInterruptMode(0);   // Active high
+  accelgyro.setInterruptLatch(1);  // Hold until read
+  accelgyro.setDHPFMode(MPU6050_DHPF_5);
+
+  if (zeroMotion) {
+    accelgyro.setZeroMotionDetectionThreshold(GYRO_ZERO_MOTION_THREASHOLD);
+    accelgyro.setZeroMotionDetectionDuration(duration > 255 ? 255 : duration);
+    accelgyro.setIntMotionEnabled(false);
+    accelgyro.setIntZeroMotionEnabled(true);
+  } else {
+    accelgyro.setMotionDetectionThreshold(GYRO_MOTION_THREASHOLD);
+    accelgyro.setMotionDetectionDuration(GYRO_MOTION_DURATION);
+    accelgyro.setIntZeroMotionEnabled(false);
+    accelgyro.setIntMotionEnabled(true);
+  }
+
+  accelgyro.setTempSensorEnabled(false);
+  accelgyro.setStandbyXGyroEnabled(true);
+  accelgyro.setStandbyYGyroEnabled(true);
+  accelgyro.setStandbyZGyroEnabled(true);
+  accelgyro.setWakeFrequency(MPU6050_WAKE_FREQ_5);
+  accelgyro.setWakeCycleEnabled(true);
+  accelgyro.getIntStatus();  // Clear any pending interrupt
+
+#if defined(ESP32C3)
+  esp_deep_sleep_enable_gpio_wakeup(1ULL << PIN_GYRO_INT,
+                                    ESP_GPIO_WAKEUP_GPIO_HIGH);
+#else
+  esp_sleep_enable_ext0_wakeup(static_cast<gpio_num_t>(PIN_GYRO_INT), 1);
+#endif
+  _motionWakeup = true;
+#endif
+}
+
+bool GyroSensor::isMotionWakeup() {
+#if defined(ENABLE_MOTION_WAKEUP)
+#if defined(ESP32C3)
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO;
+#else
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0;
+#endif
+#else
+  return false;
 #endif
 }
 
 void GyroSensor::readSensor(RawGyroData &raw, const int noIterations,
-                            const int delayTime) {
+                            const int delayTime, const bool scaled) {
   RawGyroDataL average = {0, 0, 0, 0, 0, 0};
+  bool fusion = myConfig.isGyroFusion();
+  bool scale = scaled && myConfig.hasAccelScale();
+  uint32_t sampleMicros = micros();
+
+  _fusionValid = false;
+  _fusionSeed = 0;
+  _fusion[0] = _fusion[1] = _fusion[2] = 0;
 
 #if LOG_LEVEL == 6
   Log.verbose(F("GYRO: Reading sensor with %d iterations %d us delay." CR),
@@ -138,6 +236,14 @@ void GyroSensor::readSensor(RawGyroData &raw, const int noIterations,
     accelgyro.getMotion6(&raw.ax, &raw.ay, &raw.az, &raw.gx, &raw.gy, &raw.gz);
     raw.temp = accelgyro.getTemperature();
 
+    if (scale) applyAccelScale(raw);
+
+    if (fusion) {
+      uint32_t now = micros();
+      updateFusion(raw, (now - sampleMicros) / 1000000.0);
+      sampleMicros = now;
+    }
+
     average.ax += raw.ax;
     average.ay += raw.ay;
     average.az += raw.az;
@@ -207,12 +313,23 @@ float GyroSensor::calculateAngle(RawGyroData &raw) {
   // Accelerometer full scale range of +/- 2g with Sensitivity Scale Factor of
   // 16,384 LSB(Count)/g. Gyroscope full scale range of +/- 250 °/s with
   // Sensitivity Scale Factor of 131 LSB (Count)/°/s.
-  float ax = (static_cast<float>(raw.ax)) / 16384,
-        ay = (static_cast<float>(raw.ay)) / 16384,
-        az = (static_cast<float>(raw.az)) / 16384;
-
   // Source: https://www.nxp.com/docs/en/application-note/AN3461.pdf
-  float vY = (acos(abs(ay) / sqrt(ax * ax + ay * ay + az * az)) * 180.0 / PI);
+  float vY;
+
+  if (_fusionValid) {
+    // The fused gravity vector is already normalized
+    vY = acos(abs(_fusion[1])) * 180.0 / PI;
+  } else {
+#if defined(ENABLE_FIXED_POINT)
+    vY = calculateAngleFixed(raw);
+#else
+    float ax = (static_cast<float>(raw.ax)) / 16384,
+          ay = (static_cast<float>(raw.ay)) / 16384,
+          az = (static_cast<float>(raw.az)) / 16384;
+
+    vY = (acos(abs(ay) / sqrt(ax * ax + ay * ay + az * az)) * 180.0 / PI);
+#endif
+  }
   // float vZ = (acos(abs(az) / sqrt(ax * ax + ay * ay + az * az)) * 180.0 /
   // PI); float vX = (acos(abs(ax) / sqrt(ax * ax + ay * ay + az * az)) * 180.0
   // / PI);
@@ -224,6 +341,80 @@ float GyroSensor::calculateAngle(RawGyroData &raw) {
   return vY;
 }
 
+#if defined(ENABLE_FIXED_POINT)
+// Same as the float calculation but using integer math only, the accelerometer
+// scale cancels out so the raw values can be used directly.
+float GyroSensor::calculateAngleFixed(const RawGyroData &raw) {
+  int32_t ax = raw.ax, ay = raw.ay, az = raw.az;
+  uint64_t s = static_cast<uint64_t>(ax * ax) + static_cast<uint64_t>(ay * ay) +
+               static_cast<uint64_t>(az * az);
+
+  // The length is calculated with 14 fraction bits to keep the precision when
+  // the angle is close to zero.
+  uint32_t n = fixedIntSqrt(s << 28);
+
+  if (n == 0) return 0;
+
+  Fixed<28> r = Fixed<28>::fromRaw(static_cast<int32_t>(
+      (static_cast<uint64_t>(ay < 0 ? -ay : ay) << 42) / n));
+
+  return (fixedAcos(r).convert<16>() * Fixed<16>::fromDouble(180.0 / PI))
+      .toFloat();
+}
+#endif
+
+// Complementary filter that tracks the gravity vector. The previous estimate is
+// rotated using the gyro rates and then blended with the accelerometer reading,
+// this reduce the effect of short accelerations when the device is bobbing.
+void GyroSensor::updateFusion(RawGyroData &raw, float dt) {
+  float ax = raw.ax, ay = raw.ay, az = raw.az;
+  float n = sqrt(ax * ax + ay * ay + az * az);
+
+  if (n == 0) return;
+
+  ax /= n;
+  ay /= n;
+  az /= n;
+
+  // Start from the mean of the first samples so a single noisy reading does
+  // not dominate the estimate.
+  if (!_fusionValid) {
+    _fusion[0] += ax;
+    _fusion[1] += ay;
+    _fusion[2] += az;
+
+    if (++_fusionSeed < GYRO_FUSION_SEED) return;
+
+    n = sqrt(_fusion[0] * _fusion[0] + _fusion[1] * _fusion[1] +
+             _fusion[2] * _fusion[2]);
+
+    if (n == 0) return;
+
+    _fusion[0] /= n;
+    _fusion[1] /= n;
+    _fusion[2] /= n;
+    _fusionValid = true;
+    return;
+  }
+
+  float wx = raw.gx * GYRO_RAD_PER_LSB, wy = raw.gy * GYRO_RAD_PER_LSB,
+        wz = raw.gz * GYRO_RAD_PER_LSB;
+
+  // A vector fixed in the world frame moves as v x w in the sensor frame
+  float vx = _fusion[0] + (_fusion[1] * wz - _fusion[2] * wy) * dt;
+  float vy = _fusion[1] + (_fusion[2] * wx - _fusion[0] * wz) * dt;
+  float vz = _fusion[2] + (_fusion[0] * wy - _fusion[1] * wx) * dt;
+
+  vx = GYRO_FUSION_ALPHA * vx + (1 - GYRO_FUSION_ALPHA) * ax;
+  vy = GYRO_FUSION_ALPHA * vy + (1 - GYRO_FUSION_ALPHA) * ay;
+  vz = GYRO_FUSION_ALPHA * vz + (1 - GYRO_FUSION_ALPHA) * az;
+  n = sqrt(vx * vx + vy * vy + vz * vz);
+
+  _fusion[0] = vx / n;
+  _fusion[1] = vy / n;
+  _fusion[2] = vz / n;
+}
+
 bool GyroSensor::isSensorMoving(RawGyroData &raw) {
 #if LOG_LEVEL == 6
   Log.verbose(F("GYRO: Checking for sensor movement." CR));
@@ -241,6 +432,36 @@ bool GyroSensor::isSensorMoving(RawGyroData &raw) {
   return false;
 }
 
+// The fused gravity vector compensates for the rotation during the read, so
+// it can give a reading when the device is bobbing. A fused angle that does
+// not agree with the averaged accelerometer means that the gyro has drifted
+// or that the device is handled, that reading is rejected.
+bool GyroSensor::isFusionStable(RawGyroData &raw) {
+  if (!_fusionValid) return false;
+
+  int x = abs(raw.gx), y = abs(raw.gy), z = abs(raw.gz);
+  int threashold =
+      myConfig.getGyroSensorMovingThreashold() * GYRO_FUSION_THREASHOLD_FACTOR;
+
+  if (x > threashold || y > threashold || z > threashold) return false;
+
+  float ax = raw.ax, ay = raw.ay, az = raw.az;
+  float n = sqrt(ax * ax + ay * ay + az * az);
+
+  if (n == 0) return false;
+
+  float accel = acos(fabs(ay) / n) * 180.0 / PI;
+  float fused = acos(fabs(_fusion[1])) * 180.0 / PI;
+
+  if (fabs(accel - fused) > GYRO_FUSION_MAX_DEVIATION) {
+    Log.notice(F("GYRO: Fused angle %F differs from %F." CR), fused, accel);
+    return false;
+  }
+
+  Log.notice(F("GYRO: Using fused angle for a reading with movement." CR));
+  return true;
+}
+
 bool GyroSensor::read() {
 #if LOG_LEVEL == 6
   Log.verbose(F("GYRO: Getting new gyro position." CR));
@@ -248,13 +469,16 @@ bool GyroSensor::read() {
 
   if (!_sensorConnected) return false;
 
+  // Offsets are changing while the calibration runs, keep the last value
+  if (isCalibrationRunning()) return _validValue;
+
   readSensor(_lastGyroData, myConfig.getGyroReadCount(),
              myConfig.getGyroReadDelay());  // Last param is unused if
                                             // GYRO_USE_INTERRUPT is defined.
 
   // If the sensor is unstable we return false to signal we dont have valid
-  // value
-  if (isSensorMoving(_lastGyroData)) {
+  // value, with sensor fusion some movement is accepted.
+  if (isSensorMoving(_lastGyroData) && !isFusionStable(_lastGyroData)) {
 #if LOG_LEVEL == 6
     Log.notice(F("GYRO: Sensor is moving." CR));
 #endif
@@ -308,31 +532,312 @@ void GyroSensor::applyCalibration() {
   accelgyro.setZGyroOffset(_calibrationOffset.gz);
 }
 
-void GyroSensor::calibrateSensor() {
-#if LOG_LEVEL == 6
-  Log.verbose(F("GYRO: Calibrating sensor" CR));
-#endif
-  // accelgyro.PrintActiveOffsets();
-  // EspSerial.print( CR );
+void GyroSensor::applyAccelScale(RawGyroData &raw) {
+  const AccelScaleData &s = myConfig.getAccelScale();
+
+  auto correct = [](int16_t v, float offset, float scale) {
+    float f = (v - offset) * scale;
+    return static_cast<int16_t>(f > 32767 ? 32767 : f < -32768 ? -32768 : f);
+  };
+
+  raw.ax = correct(raw.ax, s.ox, s.sx);
+  raw.ay = correct(raw.ay, s.oy, s.sy);
+  raw.az = correct(raw.az, s.oz, s.sz);
+}
 
+// Samples averaged for each position, these are collected over several calls
+// so the loop is not blocked for the ~10s it takes to read them all.
+constexpr auto GYRO_CAL_POSITION_SAMPLES = 500;
+constexpr auto GYRO_CAL_POSITION_CHUNK = 25;
+
+// Six position calibration, the device is placed with each axis pointing up
+// and down, step 1-2 is +X/-X, 3-4 is +Y/-Y and 5-6 is +Z/-Z. The offset and
+// scale for each axis is calculated when all positions are captured. Step 0
+// will remove the current scale and restart the calibration.
+int GyroSensor::calibratePosition(int step) {
+  if (step == 0) {
+    Log.notice(F("GYRO: Resetting six position calibration." CR));
+    AccelScaleData s = {0, 0, 0, 1, 1, 1};
+    myConfig.setAccelScale(s);
+    myConfig.saveFile();
+    _positionsDone = 0;
+    _positionSamples = 0;
+    return GYRO_CAL_CAPTURED;
+  }
+
+  if (step < 1 || step > GYRO_CAL_STEPS || !_sensorConnected)
+    return GYRO_CAL_FAILED;
+
+  if (step != _positionStep || !_positionSamples) {
+    _positionStep = step;
+    _positionSamples = 0;
+    _positionSum = {0, 0, 0, 0, 0, 0, 0};
+  }
+
+  RawGyroData raw;
+  readSensor(raw, GYRO_CAL_POSITION_CHUNK, 1, false);
+
+  _positionSum.ax += raw.ax * GYRO_CAL_POSITION_CHUNK;
+  _positionSum.ay += raw.ay * GYRO_CAL_POSITION_CHUNK;
+  _positionSum.az += raw.az * GYRO_CAL_POSITION_CHUNK;
+  _positionSum.gx += raw.gx * GYRO_CAL_POSITION_CHUNK;
+  _positionSum.gy += raw.gy * GYRO_CAL_POSITION_CHUNK;
+  _positionSum.gz += raw.gz * GYRO_CAL_POSITION_CHUNK;
+  _positionSamples += GYRO_CAL_POSITION_CHUNK;
+
+  if (_positionSamples < GYRO_CAL_POSITION_SAMPLES) return GYRO_CAL_RUNNING;
+
+  raw.ax = _positionSum.ax / _positionSamples;
+  raw.ay = _positionSum.ay / _positionSamples;
+  raw.az = _positionSum.az / _positionSamples;
+  raw.gx = _positionSum.gx / _positionSamples;
+  raw.gy = _positionSum.gy / _positionSamples;
+  raw.gz = _positionSum.gz / _positionSamples;
+  _positionSamples = 0;
+
+  if (isSensorMoving(raw)) return GYRO_CAL_FAILED;
+
+  // The axis for this step should have about 1g in the expected direction and
+  // the other axes close to zero.
+  int16_t v[3] = {raw.ax, raw.ay, raw.az};
+  int axis = (step - 1) / 2;
+  int sign = (step % 2) ? 1 : -1;
+
+  for (int i = 0; i < 3; i++) {
+    bool valid =
+        i == axis ? v[i] * sign > 16384 * 0.8 : abs(v[i]) < 16384 * 0.3;
+
+    if (!valid) {
+      Log.warning(F("GYRO: Device is not in position %d (%d,%d,%d)." CR), step,
+                  raw.ax, raw.ay, raw.az);
+      return GYRO_CAL_WRONG_POSITION;
+    }
+  }
+
+  _positions[step - 1] = raw;
+  _positionsDone |= 1 << (step - 1);
+  Log.notice(F("GYRO: Captured position %d (%d,%d,%d)." CR), step, raw.ax,
+             raw.ay, raw.az);
+
+  if (_positionsDone != (1 << GYRO_CAL_STEPS) - 1) return GYRO_CAL_CAPTURED;
+
+  float pos[3] = {static_cast<float>(_positions[0].ax),
+                  static_cast<float>(_positions[2].ay),
+                  static_cast<float>(_positions[4].az)};
+  float neg[3] = {static_cast<float>(_positions[1].ax),
+                  static_cast<float>(_positions[3].ay),
+                  static_cast<float>(_positions[5].az)};
+  float offset[3], scale[3];
+
+  for (int i = 0; i < 3; i++) {
+    offset[i] = (pos[i] + neg[i]) / 2;
+    scale[i] = 2 * 16384 / (pos[i] - neg[i]);
+  }
+
+  AccelScaleData s = {offset[0], offset[1], offset[2],
+                      scale[0],  scale[1],  scale[2]};
+  myConfig.setAccelScale(s);
+  myConfig.saveFile();
+  _positionsDone = 0;
+
+  Log.notice(F("GYRO: Six position calibration completed, offset %F,%F,%F "
+               "scale %F,%F,%F." CR),
+             offset[0], offset[1], offset[2], scale[0], scale[1], scale[2]);
+  return GYRO_CAL_COMPLETED;
+}
+
+int GyroSensor::getPositionProgress() {
+  return _positionSamples * 100 / GYRO_CAL_POSITION_SAMPLES;
+}
+
+// The offsets are calibrated with the same PI regulator as CalibrateAccel(6)
+// and CalibrateGyro(6) in the mpu6050 library, but split into small steps so it
+// can run from the loop without blocking the web server.
+constexpr auto GYRO_CAL_LOOPS = 6;
+constexpr auto GYRO_CAL_ITERATIONS = 100;  // PI calculations per loop
+constexpr auto GYRO_CAL_RETRIES = 5;  // Restarts of a loop if error is large
+constexpr auto GYRO_CAL_ITERATIONS_PER_STEP = 10;
+
+int16_t GyroSensor::getOffset(bool accel, int axis) {
+  switch (axis) {
+    case 0:
+      return accel ? accelgyro.getXAccelOffset() : accelgyro.getXGyroOffset();
+    case 1:
+      return accel ? accelgyro.getYAccelOffset() : accelgyro.getYGyroOffset();
+    default:
+      return accel ? accelgyro.getZAccelOffset() : accelgyro.getZGyroOffset();
+  }
+}
+
+void GyroSensor::setOffset(bool accel, int axis, float value) {
+  int16_t v;
+
+  // Bit zero of the accel offset is reserved and needs to be kept
+  if (accel)
+    v = (static_cast<int16_t>(round(value / 8)) & 0xFFFE) | _calBitZero[axis];
+  else
+    v = round(value / 4);
+
+  switch (axis) {
+    case 0:
+      accel ? accelgyro.setXAccelOffset(v) : accelgyro.setXGyroOffset(v);
+      accel ? _calibrationOffset.ax = v : _calibrationOffset.gx = v;
+      break;
+    case 1:
+      accel ? accelgyro.setYAccelOffset(v) : accelgyro.setYGyroOffset(v);
+      accel ? _calibrationOffset.ay = v : _calibrationOffset.gy = v;
+      break;
+    default:
+      accel ? accelgyro.setZAccelOffset(v) : accelgyro.setZGyroOffset(v);
+      accel ? _calibrationOffset.az = v : _calibrationOffset.gz = v;
+      break;
+  }
+}
+
+void GyroSensor::startCalibrationPhase(CalibrationPhase phase) {
+  bool accel = phase == CalibrationPhase::accel;
+  float x = (100 - map(GYRO_CAL_LOOPS, 1, 5, 20, 0)) * .01;
+
+  _calPhase = phase;
+  _calLoop = 0;
+  _calIteration = 0;
+  _calSamples = 0;
+  _calRetries = 0;
+  _calKP = 0.3 * x;
+  _calKI = (accel ? 20 : 90) * x;
+
+  for (int i = 0; i < 3; i++) {
+    int16_t v = getOffset(accel, i);
+    _calBitZero[i] = v & 1;
+    _calITerm[i] = v * (accel ? 8 : 4);
+  }
+}
+
+void GyroSensor::beginCalibration() {
+  Log.notice(F("GYRO: Starting calibration of sensor." CR));
   accelgyro.setDLPFMode(MPU6050_DLPF_BW_5);
-  accelgyro.CalibrateAccel(6);  // 6 = 600 readings
-  accelgyro.CalibrateGyro(6);
+  startCalibrationPhase(CalibrationPhase::accel);
+}
+
+// Run a limited number of iterations of the calibration, returns true when the
+// calibration is completed.
+bool GyroSensor::stepCalibration() {
+  if (!isCalibrationRunning()) return true;
+
+  bool accel = _calPhase == CalibrationPhase::accel;
+  float gravity = 16384 >> accelgyro.getFullScaleAccelRange();
+
+  for (int n = 0; n < GYRO_CAL_ITERATIONS_PER_STEP; n++) {
+    int16_t v[3];
+    float eSum = 0;
+
+    if (accel)
+      accelgyro.getAcceleration(&v[0], &v[1], &v[2]);
+    else
+      accelgyro.getRotation(&v[0], &v[1], &v[2]);
+
+    for (int i = 0; i < 3; i++) {
+      float error = -v[i];
+
+      if (accel && i == 2) error += gravity;  // Remove gravity
+
+      eSum += fabs(error);
+      _calITerm[i] += error * 0.001 * _calKI;
+      setOffset(accel, i, _calKP * error + _calITerm[i]);
+    }
+
+    _calIteration++;
+
+    if (_calIteration == GYRO_CAL_ITERATIONS && eSum > 1000 &&
+        _calRetries < GYRO_CAL_RETRIES) {
+      _calIteration = 0;  // Error is still too large to continue
+      _calRetries++;
+    }
+
+    if (eSum * (accel ? .05 : 1) < 5) _calSamples++;
+
+    if ((eSum < 100 && _calIteration > 10 && _calSamples >= 10) ||
+        _calIteration >= GYRO_CAL_ITERATIONS) {
+      // Advance to next loop with lower gain
+      _calKP *= .75;
+      _calKI *= .75;
 
-  accelgyro.PrintActiveOffsets();
-  EspSerial.print(CR);
+      for (int i = 0; i < 3; i++) setOffset(accel, i, _calITerm[i]);
 
-  _calibrationOffset.ax = accelgyro.getXAccelOffset();
-  _calibrationOffset.ay = accelgyro.getYAccelOffset();
-  _calibrationOffset.az = accelgyro.getZAccelOffset();
-  _calibrationOffset.gx = accelgyro.getXGyroOffset();
-  _calibrationOffset.gy = accelgyro.getYGyroOffset();
-  _calibrationOffset.gz = accelgyro.getZGyroOffset();
+      _calIteration = 0;
+      _calSamples = 0;
+      _calRetries = 0;
+
+      if (++_calLoop >= GYRO_CAL_LOOPS) {
+        if (accel) {
+          startCalibrationPhase(CalibrationPhase::gyro);
+        } else {
+          finishCalibration();
+        }
+        return !isCalibrationRunning();
+      }
+    }
+
+    delay(1);
+  }
+
+  return false;
+}
+
+void GyroSensor::finishCalibration() {
+  accelgyro.resetFIFO();
+  accelgyro.resetDMP();
+
+  _calPhase = CalibrationPhase::done;
+  Log.notice(F("GYRO: Calibration completed, offsets %d,%d,%d,%d,%d,%d." CR),
+             _calibrationOffset.ax, _calibrationOffset.ay,
+             _calibrationOffset.az, _calibrationOffset.gx,
+             _calibrationOffset.gy, _calibrationOffset.gz);
+
+  // The six position scale was measured with the old offsets applied, so it
+  // is no longer valid and needs to be redone.
+  if (myConfig.hasAccelScale()) {
+    Log.notice(F("GYRO: Offsets changed, removing six position scale." CR));
+    AccelScaleData s = {0, 0, 0, 1, 1, 1};
+    myConfig.setAccelScale(s);
+    _positionsDone = 0;
+  }
 
   myConfig.setGyroCalibration(_calibrationOffset);
   myConfig.saveFile();
 }
 
+void GyroSensor::cancelCalibration() {
+  _positionSamples = 0;
+
+  if (!isCalibrationRunning()) return;
+
+  Log.notice(F("GYRO: Calibration cancelled, restoring offsets." CR));
+  _calPhase = CalibrationPhase::idle;
+  _calibrationOffset = myConfig.getGyroCalibration();
+  applyCalibration();
+}
+
+int GyroSensor::getCalibrationProgress() {
+  switch (_calPhase) {
+    case CalibrationPhase::accel:
+    case CalibrationPhase::gyro: {
+      // Counted against the maximum number of passes per loop, so a retry
+      // that restarts the iterations never moves the progress back.
+      constexpr int passes = GYRO_CAL_RETRIES + 1;
+      int loops = (_calPhase == CalibrationPhase::gyro ? GYRO_CAL_LOOPS : 0) +
+                  _calLoop;
+      int done = (loops * passes + _calRetries) * GYRO_CAL_ITERATIONS +
+                 _calIteration;
+      return done * 100 / (2 * GYRO_CAL_LOOPS * passes * GYRO_CAL_ITERATIONS);
+    }
+    case CalibrationPhase::done:
+      return 100;
+    default:
+      return 0;
+  }
+}
+
 void GyroSensor::debug() {
 #if LOG_LEVEL == 6
   Log.verbose(F("GYRO: Debug - Clock src   %d." CR),
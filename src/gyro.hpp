@@ -43,6 +43,16 @@ struct RawGyroDataL {  // Used for average multiple readings
 
 #define INVALID_TEMPERATURE -273
 
+// Results from the six position calibration steps
+constexpr auto GYRO_CAL_CAPTURED = 0;
+constexpr auto GYRO_CAL_COMPLETED = 1;
+constexpr auto GYRO_CAL_RUNNING = 2;  // Call again to collect more samples
+constexpr auto GYRO_CAL_WRONG_POSITION = -1;
+constexpr auto GYRO_CAL_FAILED = -2;
+constexpr auto GYRO_CAL_STEPS = 6;
+
+enum class CalibrationPhase { idle, accel, gyro, done };
+
 class GyroSensor {
  private:
   bool _sensorConnected = false;
@@ -52,19 +62,58 @@ class GyroSensor {
   float _initialSensorTemp = INVALID_TEMPERATURE;
   RawGyroData _calibrationOffset;
   RawGyroData _lastGyroData;
+  float _fusion[3] = {0, 0, 0};  // Estimated gravity vector (unit length)
+  bool _fusionValid = false;
+  int _fusionSeed = 0;
+  bool _motionWakeup = false;
+  RawGyroData _positions[GYRO_CAL_STEPS];  // Six position calibration
+  uint8_t _positionsDone = 0;
+  int _positionStep = 0;
+  int _positionSamples = 0;
+  RawGyroDataL _positionSum = {0, 0, 0, 0, 0, 0, 0};
+  CalibrationPhase _calPhase = CalibrationPhase::idle;  // Offset calibration
+  int _calLoop = 0;
+  int _calIteration = 0;
+  int _calSamples = 0;
+  int _calRetries = 0;
+  float _calKP = 0;
+  float _calKI = 0;
+  float _calITerm[3] = {0, 0, 0};
+  int16_t _calBitZero[3] = {0, 0, 0};
 
   void debug();
   void applyCalibration();
   void dumpCalibration();
   void readSensor(RawGyroData &raw, const int noIterations = 100,
-                  const int delayTime = 1);
+                  const int delayTime = 1, const bool scaled = true);
+  void applyAccelScale(RawGyroData &raw);
+#if defined(ENABLE_FIXED_POINT)
+  float calculateAngleFixed(const RawGyroData &raw);
+#endif
+  void updateFusion(RawGyroData &raw, float dt);
   bool isSensorMoving(RawGyroData &raw);
+  bool isFusionStable(RawGyroData &raw);
   float calculateAngle(RawGyroData &raw);
+  int16_t getOffset(bool accel, int axis);
+  void setOffset(bool accel, int axis, float value);
+  void startCalibrationPhase(CalibrationPhase phase);
+  void finishCalibration();
 
  public:
   bool setup();
   bool read();
-  void calibrateSensor();
+  void beginCalibration();
+  bool stepCalibration();
+  void cancelCalibration();
+  bool isCalibrationRunning() {
+    return _calPhase == CalibrationPhase::accel ||
+           _calPhase == CalibrationPhase::gyro;
+  }
+  int getCalibrationProgress();
+  const RawGyroData &getCalibrationOffset() { return _calibrationOffset; }
+  int calibratePosition(int step);
+  uint8_t getCalibratedPositions() { return _positionsDone; }
+  int getPositionProgress();
   uint8_t getGyroID();
 
   const RawGyroData &getLastGyroData() { return _lastGyroData; }
@@ -74,6 +123,8 @@ class GyroSensor {
   bool isConnected() { return _sensorConnected; }
   bool hasValue() { return _validValue; }
   void enterSleep();
+  void enableMotionWakeup(bool zeroMotion);
+  bool isMotionWakeup();
 };
 
 extern GyroSensor myGyro;
@@ -127,6 +127,9 @@ void printBuildOptions() {
 #endif
 #ifdef COLLECT_PERFDATA
                "PERFDATA "
+#endif
+#ifdef COLLECT_ALLOCDATA
+               "ALLOCDATA "
 #endif
                CR),
              CFG_APPVER, CFG_GITREV, LOG_LEVEL);
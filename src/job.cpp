@@ -0,0 +1,219 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <job.hpp>
+#include <log.hpp>
+
+JobScheduler myJobs;
+
+// Jobs are submitted and read from the web handlers, on ESP32 these run in
+// another task than the loop. The lock is only held while the scheduler
+// updates a slot, never while a step is running.
+#if defined(ESP32)
+#define JOB_LOCK() std::lock_guard<std::mutex> guard(_lock)
+#else
+#define JOB_LOCK()
+#endif
+
+// Returns the id of the new job or JOB_INVALID_ID if the queue is full. The
+// slot of the oldest finished job is reused, so results are kept until the
+// slot is needed.
+int JobScheduler::submit(const char *name, JobStep step) {
+  JOB_LOCK();
+  Job *slot = nullptr;
+
+  for (int i = 0; i < JOB_QUEUE_SIZE; i++) {
+    JobState s = _jobs[i].state;
+
+    if (s == JobState::free) {
+      slot = &_jobs[i];
+      break;
+    }
+
+    if (s != JobState::queued && s != JobState::running &&
+        (!slot || _jobs[i].id < slot->id))
+      slot = &_jobs[i];
+  }
+
+  if (!slot) {
+    Log.warning(F("JOB : Queue is full, unable to schedule %s." CR), name);
+    return JOB_INVALID_ID;
+  }
+
+  slot->id = _nextId++;
+  slot->name = name;
+  slot->cancelled = false;
+  slot->progress = 0;
+  slot->success = false;
+  slot->result = "";
+  slot->started = 0;
+  slot->duration = 0;
+  slot->step = step;
+  slot->state = JobState::queued;
+  publish(slot);
+
+  Log.notice(F("JOB : Scheduled job %d, %s." CR), slot->id, name);
+  return slot->id;
+}
+
+bool JobScheduler::cancel(int id) {
+  JOB_LOCK();
+  Job *job = find(id);
+
+  if (!job) return false;
+
+  if (job->state == JobState::queued) {
+    job->state = JobState::cancelled;
+    job->step = nullptr;
+    publish(job);
+    return true;
+  }
+
+  if (job->state == JobState::running) {
+    job->cancelled = true;  // Handled in the loop
+    return true;
+  }
+
+  return false;
+}
+
+Job *JobScheduler::find(int id) {
+  for (int i = 0; i < JOB_QUEUE_SIZE; i++) {
+    if (_jobs[i].state != JobState::free && _jobs[i].id == id)
+      return &_jobs[i];
+  }
+
+  return nullptr;
+}
+
+bool JobScheduler::getStatus(int id, JobStatus &status) {
+  JOB_LOCK();
+  Job *job = find(id);
+
+  if (!job) return false;
+
+  status = job->status;
+  return true;
+}
+
+bool JobScheduler::isActive(int id) {
+  JOB_LOCK();
+  Job *job = find(id);
+  return job &&
+         (job->state == JobState::queued || job->state == JobState::running);
+}
+
+// Jobs are run one at a time in the order they were scheduled.
+Job *JobScheduler::next() {
+  Job *job = nullptr;
+
+  for (int i = 0; i < JOB_QUEUE_SIZE; i++) {
+    if (_jobs[i].state == JobState::running) return &_jobs[i];
+
+    if (_jobs[i].state == JobState::queued && (!job || _jobs[i].id < job->id))
+      job = &_jobs[i];
+  }
+
+  return job;
+}
+
+// Called with the lock held. The result is only copied when the job has
+// finished so a running job does not copy the string on every slice.
+void JobScheduler::publish(Job *job) {
+  job->status.id = job->id;
+  job->status.name = job->name;
+  job->status.state = job->state;
+  job->status.progress = job->progress;
+  job->status.success = job->success;
+  job->status.duration = job->duration;
+
+  if (job->state != JobState::running) job->status.result = job->result;
+}
+
+void JobScheduler::loop() {
+  Job *job;
+
+  {
+    JOB_LOCK();
+    job = next();
+
+    if (!job) return;
+
+    if (job->state == JobState::queued) {
+      Log.notice(F("JOB : Starting job %d, %s." CR), job->id, job->name);
+      job->state = JobState::running;
+      job->started = millis();
+      publish(job);
+    }
+  }
+
+  uint32_t start = millis();
+  bool done = false;
+
+  do {
+    done = job->step(*job);
+  } while (!done && !job->cancelled && millis() - start < JOB_TIME_SLICE);
+
+  // Read once, a cancel arriving after this is handled in the next loop
+  bool cancelled = job->cancelled;
+  if (cancelled && !done) job->step(*job);  // Let the job clean up
+
+  JOB_LOCK();
+  job->duration = millis() - job->started;
+
+  // A job that finished in the same slice as a cancel arrived has its result
+  if (done) {
+    Log.notice(F("JOB : Job %d, %s completed in %d ms, success=%s." CR),
+               job->id, job->name, job->duration,
+               job->success ? "true" : "false");
+    job->progress = 100;
+    job->state = job->success ? JobState::completed : JobState::failed;
+  } else if (cancelled) {
+    Log.notice(F("JOB : Cancelled job %d, %s." CR), job->id, job->name);
+    job->state = JobState::cancelled;
+  }
+
+  if (job->state != JobState::running)
+    job->step = nullptr;  // Release captured data
+
+  publish(job);
+}
+
+const char *JobScheduler::getStateName(JobState state) {
+  switch (state) {
+    case JobState::queued:
+      return "queued";
+    case JobState::running:
+      return "running";
+    case JobState::completed:
+      return "completed";
+    case JobState::failed:
+      return "failed";
+    case JobState::cancelled:
+      return "cancelled";
+    default:
+      return "free";
+  }
+}
+
+// EOF
@@ -0,0 +1,99 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_JOB_HPP_
+#define SRC_JOB_HPP_
+
+#include <Arduino.h>
+
+#include <functional>
+#if defined(ESP32)
+#include <mutex>
+#endif
+
+constexpr auto JOB_QUEUE_SIZE = 4;
+constexpr auto JOB_TIME_SLICE = 20;  // ms of work per loop
+constexpr auto JOB_INVALID_ID = -1;
+
+enum class JobState { free, queued, running, completed, failed, cancelled };
+
+struct Job;
+
+// Called repeatedly from the loop until it returns true, a step should only do
+// a small amount of work. When the job is cancelled while running the step is
+// called once more with cancelled set so it can restore its state.
+typedef std::function<bool(Job &job)> JobStep;
+
+// Copy of a job for the web handlers. On ESP32 these run in the async tcp task
+// while the steps run in the loop, so they should not read a Job directly.
+struct JobStatus {
+  int id = JOB_INVALID_ID;
+  const char *name = "";
+  JobState state = JobState::free;
+  int progress = 0;
+  bool success = false;
+  uint32_t duration = 0;
+  String result;  // Only published once the job has finished
+};
+
+struct Job {
+  int id = JOB_INVALID_ID;
+  const char *name = "";
+  volatile JobState state = JobState::free;
+  volatile bool cancelled = false;
+  int progress = 0;      // Percent
+  bool success = false;  // Set by the step before returning true
+  String result;         // Json document returned by the status api
+  uint32_t started = 0;
+  uint32_t duration = 0;
+  JobStep step;
+  JobStatus status;  // Published by the scheduler, see getStatus()
+};
+
+class JobScheduler {
+ private:
+  Job _jobs[JOB_QUEUE_SIZE];
+  int _nextId = 1;
+#if defined(ESP32)
+  std::mutex _lock;
+#endif
+
+  Job *next();
+  void publish(Job *job);
+
+ public:
+  int submit(const char *name, JobStep step);
+  bool cancel(int id);
+  Job *find(int id);  // Only safe to use from the loop
+  bool getStatus(int id, JobStatus &status);
+  bool isActive(int id);
+  void loop();
+
+  static const char *getStateName(JobState state);
+};
+
+extern JobScheduler myJobs;
+
+#endif  // SRC_JOB_HPP_
+
+// EOF
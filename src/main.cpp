@@ -24,6 +24,7 @@ SOFTWARE.
 #include <ble.hpp>
 #undef LOG_LEVEL_ERROR
 #undef LOG_LEVEL_INFO
+#include <allocprof.hpp>
 #include <battery.hpp>
 #include <calc.hpp>
 #include <config.hpp>
@@ -36,12 +37,17 @@ SOFTWARE.
 #include <ota.hpp>
 #include <perf.hpp>
 #include <pushtarget.hpp>
+#include <rtcmem.hpp>
 #include <serialws.hpp>
 #include <tempsensor.hpp>
 #include <utils.hpp>
 #include <webserver.hpp>
 #include <wificonnection.hpp>
 
+#if defined(ENABLE_MOTION_WAKEUP)
+#include <esp_sleep.h>
+#endif
+
 const char* CFG_APPNAME = "gravitymon";
 const char* CFG_FILENAME = "/gravitymon2.json";
 const char* CFG_AP_SSID = "GravityMon";
@@ -75,13 +81,29 @@ bool sleepModeAlwaysSkip =
     false;  // Flag set in web interface to override normal behaviour
 uint32_t loopMillis = 0;  // Used for main loop to run the code every _interval_
 uint32_t pushMillis = 0;  // Used to control how often we will send push data
+#if defined(COLLECT_ALLOCDATA)
+uint32_t allocMillis = 0;  // Used to control how often the alloc report is sent
+#endif
 uint32_t runtimeMillis;   // Used to calculate the total time since start/wakeup
 uint32_t stableGyroMillis;  // Used to calculate the total time since last
                             // stable gyro reading
+// Tuning of the gravity and temperature filter, noise is given as variance
+constexpr auto FILTER_GRAVITY_PROCESS_NOISE = 0.0003 * 0.0003;
+constexpr auto FILTER_GRAVITY_MEASUREMENT_NOISE = 0.0010 * 0.0010;
+constexpr auto FILTER_GRAVITY_RESET_LIMIT = 0.010;  // SG
+constexpr auto FILTER_TEMP_PROCESS_NOISE = 0.3 * 0.3;
+constexpr auto FILTER_TEMP_MEASUREMENT_NOISE = 0.2 * 0.2;
+constexpr auto FILTER_TEMP_RESET_LIMIT = 5.0;  // C
+
+bool skipWifiPush = false;  // Reading is within the push deadband, no need to
+                            // connect to wifi
 
 RunMode runMode = RunMode::gravityMode;
 
 void checkSleepMode(float angle, float volt);
+bool checkPushDeadband(float angle);
+int getAdaptiveSleepInterval();
+void goToSleep(int sleepInterval);
 
 void setup() {
   PERF_BEGIN("run-time");
@@ -108,6 +130,7 @@ void setup() {
   myConfig.migrateSettings();
   myConfig.migrateHwSettings();
   myConfig.loadFile();
+  myRtcMemory.load();
   PERF_END("main-config-load");
 
   // For restoring ispindel backup to test migration
@@ -172,6 +195,21 @@ void setup() {
         Log.notice(F("Main: Gyro is disabled in configuration." CR));
       }
 
+      if (myGyro.isMotionWakeup()) {
+        Log.notice(F("Main: Woken up by motion detected by the gyro." CR));
+
+#if defined(ENABLE_MOTION_WAKEUP)
+        // Dont start wifi or the web server while the device is handled, go
+        // back to sleep until it has been still for a while.
+        if (!myConfig.isGyroDisabled() && !myGyro.hasValue()) {
+          Log.notice(
+              F("Main: Device is moving, sleeping until it is still." CR));
+          myGyro.enableMotionWakeup(true);
+          goToSleep(myConfig.getSleepInterval());
+        }
+#endif
+      }
+
       myBatteryVoltage.read();
       checkSleepMode(myGyro.getAngle(), myBatteryVoltage.getVoltage());
       Log.notice(F("Main: Battery %F V, Gyro=%F, Run-mode=%d." CR),
@@ -186,6 +224,19 @@ void setup() {
       }
 #endif
 
+      PERF_BEGIN("main-temp-setup");
+      myTempSensor.setup();
+      PERF_END("main-temp-setup");
+
+      if (needWifi && runMode == RunMode::gravityMode &&
+          checkPushDeadband(myGyro.getAngle())) {
+        Log.notice(
+            F("Main: Reading is within push deadband, skipping wifi "
+              "connection." CR));
+        needWifi = false;
+        skipWifiPush = true;
+      }
+
       if (needWifi) {
         PERF_BEGIN("main-wifi-connect");
         if (myConfig.isWifiDirect() && runMode == RunMode::gravityMode) {
@@ -195,10 +246,6 @@ void setup() {
         }
         PERF_END("main-wifi-connect");
       }
-
-      PERF_BEGIN("main-temp-setup");
-      myTempSensor.setup();
-      PERF_END("main-temp-setup");
       break;
   }
 
@@ -269,18 +316,41 @@ bool loopReadGravity() {
     PERF_END("loop-temp-read");
 
     float gravitySG = calculateGravity(angle, tempC);
+    float rawGravitySG = gravitySG, rawTempC = tempC;
+    bool filtered = false;
+
+    // The filter state is updated once per wake cycle so this is only done in
+    // gravity mode.
+    if (myConfig.isGravityFilter() && runMode == RunMode::gravityMode) {
+      gravitySG = applyKalmanFilter(myRtcMemory.getGravityFilter(), gravitySG,
+                                    FILTER_GRAVITY_PROCESS_NOISE,
+                                    FILTER_GRAVITY_MEASUREMENT_NOISE,
+                                    FILTER_GRAVITY_RESET_LIMIT);
+      tempC = applyKalmanFilter(myRtcMemory.getTempFilter(), tempC,
+                                FILTER_TEMP_PROCESS_NOISE,
+                                FILTER_TEMP_MEASUREMENT_NOISE,
+                                FILTER_TEMP_RESET_LIMIT);
+      filtered = true;
+    }
+
     float corrGravitySG = gravityTemperatureCorrectionC(
         gravitySG, tempC, myConfig.getDefaultCalibrationTemp());
 
     if (myConfig.isGravityTempAdj()) {
       gravitySG = corrGravitySG;
+      rawGravitySG = filtered ? gravityTemperatureCorrectionC(
+                                    rawGravitySG, rawTempC,
+                                    myConfig.getDefaultCalibrationTemp())
+                              : corrGravitySG;
     }
 #if LOG_LEVEL == 6
     Log.verbose(F("Main: Sensor values gyro angle=%F, temp=%FC, gravity=%F, "
-                  "corr_gravity=%F." CR),
-                angle, tempC, gravitySG, corrGravitySG);
+                  "corr_gravity=%F, raw_gravity=%F, raw_temp=%FC." CR),
+                angle, tempC, gravitySG, corrGravitySG, rawGravitySG, rawTempC);
 #endif
 
+    if (runMode == RunMode::gravityMode) myRtcMemory.addGravity(rawGravitySG);
+
     bool pushExpired = (abs((int32_t)(millis() - pushMillis)) >
                         (myConfig.getSleepInterval() * 1000));
 
@@ -334,7 +404,8 @@ bool loopReadGravity() {
           GravmonPush push(&myConfig);
           push.setupTemplateEngine(engine, angle, gravitySG, corrGravitySG,
                                    tempC, (millis() - runtimeMillis) / 1000,
-                                   myBatteryVoltage.getVoltage());
+                                   myBatteryVoltage.getVoltage(), rawGravitySG,
+                                   rawTempC);
           String tpl = push.getTemplate(GravmonPush::TEMPLATE_HTTP1,
                                         true);  // Use default post template
           String payload = engine.create(tpl.c_str());
@@ -344,12 +415,20 @@ bool loopReadGravity() {
           myConfig.setHeader1HttpPost("Content-Type: application/json");
           myConfig.setHeader2HttpPost("");
           push.sendHttpPost(payload);
+
+          // The deadband check compares with unfiltered readings
+          if (push.getLastSuccess())
+            myRtcMemory.setLastPush(rawGravitySG, rawTempC);
         } else {
           Log.notice(F("Main: Sending data to all defined push targets." CR));
 
           GravmonPush push(&myConfig);
-          push.sendAll(angle, gravitySG, corrGravitySG, tempC,
-                       (millis() - runtimeMillis) / 1000);
+          // Only move the baseline when every target got the reading, a
+          // failed target is retried even if the value stays in the deadband
+          if (push.sendAll(angle, gravitySG, corrGravitySG, tempC,
+                           (millis() - runtimeMillis) / 1000, rawGravitySG,
+                           rawTempC))
+            myRtcMemory.setLastPush(rawGravitySG, rawTempC);
         }
       }
       PERF_END("loop-push");
@@ -405,11 +484,15 @@ void goToSleep(int sleepInterval) {
   myGyro.enterSleep();
   PERF_END("run-time");
   PERF_PUSH();
+  ALLOC_REPORT(EspSerial);
 
   if (myConfig.isBatterySaving() && (volt < 3.73 && volt > 2.0)) {
     sleepInterval = 3600;
   }
 
+  myRtcMemory.addElapsedTime(sleepInterval + runtime / 1000);
+  myRtcMemory.save();
+
   delay(100);
   deepSleep(sleepInterval);
 }
@@ -425,6 +508,12 @@ void loop() {
       myWebServer.loop();
       myWifi.loop();
       loopGravityOnInterval();
+#if defined(COLLECT_ALLOCDATA)
+      if (abs((int32_t)(millis() - allocMillis)) > 60000) {
+        ALLOC_REPORT(mySerialWebSocket);
+        allocMillis = millis();
+      }
+#endif
       delay(1);
 
       // If we switched mode, dont include this in the log.
@@ -434,9 +523,9 @@ void loop() {
     case RunMode::gravityMode:
       // If we didnt get a wifi connection, we enter sleep for a short time to
       // conserve battery.
-      if (!myWifi.isConnected() &&
-          myConfig.isWifiPushActive()) {  // no connection to wifi and we have
-                                          // defined push targets.
+      if (!myWifi.isConnected() && myConfig.isWifiPushActive() &&
+          !skipWifiPush) {  // no connection to wifi and we have defined push
+                            // targets.
         Log.notice(
             F("MAIN: No connection to wifi established, sleeping for 60s." CR));
         myWifi.stopDoubleReset();
@@ -445,18 +534,28 @@ void loop() {
 
       if (loopReadGravity()) {
         myWifi.stopDoubleReset();
-        goToSleep(myConfig.getSleepInterval());
+        goToSleep(getAdaptiveSleepInterval());
       }
 
       // If the sensor is moving and we are not getting a clear reading, we
       // enter sleep for a short time to conserve battery.
       if (((millis() - stableGyroMillis) >
            10000L)) {  // 10s since last stable gyro reading
+        myWifi.stopDoubleReset();
+#if defined(ENABLE_MOTION_WAKEUP)
+        // Wake up as soon as the device has been still for a while, the
+        // normal interval is used as fallback.
+        Log.notice(
+            F("MAIN: Unable to get a stable reading for 10s, sleeping until "
+              "the device is still." CR));
+        myGyro.enableMotionWakeup(true);
+        goToSleep(myConfig.getSleepInterval());
+#else
         Log.notice(
             F("MAIN: Unable to get a stable reading for 10s, sleeping for "
               "60s." CR));
-        myWifi.stopDoubleReset();
         goToSleep(60);
+#endif
       }
 
       if (!myConfig.isGyroDisabled()) {
@@ -469,6 +568,83 @@ void loop() {
   }
 }
 
+// Check if the current reading is close enough to the values that was last
+// pushed so we can skip the wifi connection during this wake cycle. Return true
+// if the push can be skipped.
+bool checkPushDeadband(float angle) {
+  if (!myConfig.isPushDeadbandActive() || !myRtcMemory.hasLastPush() ||
+      !myGyro.hasValue())
+    return false;
+
+  if (myRtcMemory.getSecondsSincePush() >=
+      static_cast<uint32_t>(myConfig.getPushMaxSilence())) {
+    Log.notice(F("Main: Maximum silence reached, forcing push." CR));
+    return false;
+  }
+
+  myTempSensor.readSensor(myConfig.isGyroTemp());
+  float tempC = myTempSensor.getTempC();
+  float gravitySG = calculateGravity(angle, tempC);
+
+  if (myConfig.isGravityTempAdj()) {
+    gravitySG = gravityTemperatureCorrectionC(
+        gravitySG, tempC, myConfig.getDefaultCalibrationTemp());
+  }
+
+  float deltaGravity = abs(gravitySG - myRtcMemory.getLastPushGravitySG());
+  float deltaTemp = abs(tempC - myRtcMemory.getLastPushTempC());
+
+#if LOG_LEVEL == 6
+  Log.verbose(F("Main: Deadband check, gravity delta=%F, temp delta=%F." CR),
+              deltaGravity, deltaTemp);
+#endif
+
+  if (deltaGravity >= myConfig.getPushDeadbandGravity()) return false;
+
+  // A temperature deadband of 0 means that temperature is not checked
+  if (myConfig.getPushDeadbandTemp() > 0 &&
+      deltaTemp >= myConfig.getPushDeadbandTemp())
+    return false;
+
+  return true;
+}
+
+// Adjust the sleep interval based on how fast the gravity is changing. During
+// active fermentation we use the minimum interval and when the gravity is
+// stable we use the maximum interval.
+int getAdaptiveSleepInterval() {
+  constexpr auto RATE_ACTIVE = 0.0005;  // SG/h
+  constexpr auto RATE_IDLE = 0.00005;   // SG/h
+
+  int sleepInterval = myConfig.getSleepInterval();
+
+  if (!myConfig.isSleepAdaptive() ||
+      myRtcMemory.getGravityHistoryCount() < 3)
+    return sleepInterval;
+
+  double rate = abs(calculateGravityRate(myRtcMemory.getGravityHistory(),
+                                         myRtcMemory.getGravityHistoryTime(),
+                                         myRtcMemory.getGravityHistoryCount()));
+  int minInterval = myConfig.getSleepIntervalMin();
+  int maxInterval = myConfig.getSleepIntervalMax();
+
+  // The limits are validated one by one so they can still be swapped
+  if (minInterval > maxInterval) std::swap(minInterval, maxInterval);
+
+  if (rate >= RATE_ACTIVE) {
+    sleepInterval = minInterval;
+  } else if (rate <= RATE_IDLE) {
+    sleepInterval = maxInterval;
+  } else {
+    sleepInterval = maxInterval - (maxInterval - minInterval) *
+                                      (rate - RATE_IDLE) /
+                                      (RATE_ACTIVE - RATE_IDLE);
+  }
+
+  Log.notice(F("Main: Adaptive sleep interval %ds." CR), sleepInterval);
+  return sleepInterval;
+}
+
 void checkSleepMode(float angle, float volt) {
 #if defined(SKIP_SLEEPMODE)
   runMode = RunMode::configurationMode;
@@ -536,7 +712,12 @@ void checkSleepMode(float angle, float volt) {
   if (runMode == RunMode::storageMode) {
     Log.notice(
         F("Main: Storage mode entered, going to sleep for maximum time." CR));
-#if defined(ESP8266)
+#if defined(ENABLE_MOTION_WAKEUP)
+    // Sleep until the device is moved, checkSleepMode will run again on wakeup
+    myGyro.enableMotionWakeup(false);
+    myGyro.enterSleep();
+    esp_deep_sleep_start();
+#elif defined(ESP8266)
     ESP.deepSleep(0);  // indefinite sleep
 #else
     ESP.deepSleep(0);  // indefinite sleep
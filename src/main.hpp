@@ -109,6 +109,19 @@ extern RunMode runMode;
 #define ENABLE_BLE
 #endif
 
+// The gyro can wake the device on motion if the INT pin of the gyro is
+// connected to a GPIO that can be used as wakeup source. This is not part of
+// the standard hardware so it needs to be enabled with -D PIN_GYRO_INT=<gpio>.
+#if defined(PIN_GYRO_INT) && !defined(ESP8266) && !defined(FLOATY)
+#define ENABLE_MOTION_WAKEUP
+#endif
+
+// Use fixed point math for angle, gravity, temperature correction and voltage
+// on platforms without FPU, enable with -D ENABLE_FIXED_POINT
+#if defined(ENABLE_FIXED_POINT)
+#include <fixedpoint.hpp>
+#endif
+
 constexpr auto DECIMALS_SG = 4;
 constexpr auto DECIMALS_PLATO = 2;
 constexpr auto DECIMALS_TEMP = 2;
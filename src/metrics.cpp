@@ -0,0 +1,185 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <log.hpp>
+#include <metrics.hpp>
+
+RequestMetrics myMetrics;
+
+// Upper bound of each latency bucket in us, slower requests are only counted
+// in the +Inf bucket.
+const uint32_t metricsBuckets[METRICS_BUCKETS] = {
+    5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+
+uint32_t getLargestFreeBlock() {
+#if defined(ESP8266)
+  return ESP.getMaxFreeBlockSize();
+#else
+  return ESP.getMaxAllocHeap();
+#endif
+}
+
+RouteMetrics *RequestMetrics::add(const char *route, const char *method) {
+  for (int i = 0; i < _count; i++) {
+    if (!strcmp(_routes[i].route, route) && !strcmp(_routes[i].method, method))
+      return &_routes[i];
+  }
+
+  if (_count >= METRICS_MAX_ROUTES) {
+    Log.warning(F("METR: No space left for metrics of route %s." CR), route);
+    return nullptr;
+  }
+
+  _routes[_count].route = route;
+  _routes[_count].method = method;
+  return &_routes[_count++];
+}
+
+RequestSample RequestMetrics::begin() { return {micros(), ESP.getFreeHeap()}; }
+
+void RequestMetrics::end(RouteMetrics *m, const RequestSample &sample) {
+  if (!m) return;
+
+  uint32_t duration = micros() - sample.start;
+  int32_t delta = static_cast<int32_t>(ESP.getFreeHeap()) -
+                  static_cast<int32_t>(sample.freeHeap);
+  uint32_t block = getLargestFreeBlock();
+
+  m->count++;
+  m->sum += duration;
+  if (duration > m->max) m->max = duration;
+  if (delta < m->heapDelta) m->heapDelta = delta;
+  if (block < m->minFreeBlock) m->minFreeBlock = block;
+
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    if (duration <= metricsBuckets[i]) {
+      m->buckets[i]++;
+      break;
+    }
+  }
+}
+
+// Estimated from the histogram by interpolating within the bucket where the
+// quantile is found.
+uint32_t RequestMetrics::quantile(const RouteMetrics &m, float q) {
+  uint32_t rank = ceil(q * m.count), total = 0, lower = 0;
+
+  if (!m.count) return 0;
+
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    if (m.buckets[i] && total + m.buckets[i] >= rank) {
+      uint32_t upper = min(metricsBuckets[i], m.max);
+      return lower + (upper - lower) * (rank - total) / m.buckets[i];
+    }
+
+    total += m.buckets[i];
+    lower = metricsBuckets[i];
+  }
+
+  return m.max;
+}
+
+// Writes the metric name and the route labels, the caller adds any extra
+// labels, the closing brace and the value.
+void RequestMetrics::writeName(Print &out, const char *name,
+                               const RouteMetrics &m) {
+  out.printf("gravitymon_http_%s{route=\"%s\",method=\"%s\"", name, m.route,
+             m.method);
+}
+
+void RequestMetrics::writePrometheus(Print &out) {
+  const float quantiles[] = {0.5, 0.9, 0.99};
+
+  out.print(F("# HELP gravitymon_http_requests_total Handled requests.\n"
+              "# TYPE gravitymon_http_requests_total counter\n"));
+  for (int i = 0; i < _count; i++) {
+    writeName(out, "requests_total", _routes[i]);
+    out.printf("} %u\n", _routes[i].count);
+  }
+
+  out.print(F("# HELP gravitymon_http_requests_rejected_total Requests "
+              "refused with 503.\n"
+              "# TYPE gravitymon_http_requests_rejected_total counter\n"));
+  for (int i = 0; i < _count; i++) {
+    writeName(out, "requests_rejected_total", _routes[i]);
+    out.printf("} %u\n", _routes[i].rejected);
+  }
+
+  out.print(F("# HELP gravitymon_http_request_duration_seconds Time spent "
+              "in the handler.\n"
+              "# TYPE gravitymon_http_request_duration_seconds histogram\n"));
+  for (int i = 0; i < _count; i++) {
+    const RouteMetrics &m = _routes[i];
+    uint32_t total = 0;
+
+    for (int j = 0; j < METRICS_BUCKETS; j++) {
+      total += m.buckets[j];
+      writeName(out, "request_duration_seconds_bucket", m);
+      out.printf(",le=\"%.3f\"} %u\n", metricsBuckets[j] / 1000000.0, total);
+    }
+
+    writeName(out, "request_duration_seconds_bucket", m);
+    out.printf(",le=\"+Inf\"} %u\n", m.count);
+    writeName(out, "request_duration_seconds_sum", m);
+    out.printf("} %.6f\n", m.sum / 1000000.0);
+    writeName(out, "request_duration_seconds_count", m);
+    out.printf("} %u\n", m.count);
+  }
+
+  out.print(F("# HELP gravitymon_http_request_latency_seconds Estimated "
+              "latency quantiles.\n"
+              "# TYPE gravitymon_http_request_latency_seconds gauge\n"));
+  for (int i = 0; i < _count; i++) {
+    for (float q : quantiles) {
+      writeName(out, "request_latency_seconds", _routes[i]);
+      out.printf(",quantile=\"%g\"} %.6f\n", q,
+                 quantile(_routes[i], q) / 1000000.0);
+    }
+  }
+
+  out.print(F("# HELP gravitymon_http_request_heap_delta_bytes Largest "
+              "decrease of free heap during a request.\n"
+              "# TYPE gravitymon_http_request_heap_delta_bytes gauge\n"));
+  for (int i = 0; i < _count; i++) {
+    writeName(out, "request_heap_delta_bytes", _routes[i]);
+    out.printf("} %d\n", _routes[i].heapDelta);
+  }
+
+  out.print(F("# HELP gravitymon_http_request_min_free_block_bytes Smallest "
+              "largest free block after a request.\n"
+              "# TYPE gravitymon_http_request_min_free_block_bytes gauge\n"));
+  for (int i = 0; i < _count; i++) {
+    if (!_routes[i].count) continue;
+
+    writeName(out, "request_min_free_block_bytes", _routes[i]);
+    out.printf("} %u\n", _routes[i].minFreeBlock);
+  }
+
+  out.printf("# TYPE gravitymon_free_heap_bytes gauge\n"
+             "gravitymon_free_heap_bytes %u\n"
+             "# TYPE gravitymon_max_free_block_bytes gauge\n"
+             "gravitymon_max_free_block_bytes %u\n",
+             ESP.getFreeHeap(), getLargestFreeBlock());
+}
+
+// EOF
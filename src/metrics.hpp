@@ -0,0 +1,75 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_METRICS_HPP_
+#define SRC_METRICS_HPP_
+
+#include <Arduino.h>
+
+constexpr auto METRICS_MAX_ROUTES = 24;
+constexpr auto METRICS_BUCKETS = 8;
+
+struct RouteMetrics {
+  const char *route = nullptr;
+  const char *method = nullptr;
+  uint32_t count = 0;
+  uint32_t rejected = 0;  // Refused by admission control
+  uint64_t sum = 0;  // us
+  uint32_t max = 0;  // us
+  uint32_t buckets[METRICS_BUCKETS] = {};  // Requests per latency bucket
+  int32_t heapDelta = 0;                   // Largest decrease of free heap
+  uint32_t minFreeBlock = UINT32_MAX;
+};
+
+struct RequestSample {
+  uint32_t start;
+  uint32_t freeHeap;
+};
+
+// Aggregates latency and heap usage per web route, exported in prometheus
+// text format.
+class RequestMetrics {
+ private:
+  RouteMetrics _routes[METRICS_MAX_ROUTES];
+  int _count = 0;
+
+  uint32_t quantile(const RouteMetrics &m, float q);
+  void writeName(Print &out, const char *name, const RouteMetrics &m);
+
+ public:
+  RouteMetrics *add(const char *route, const char *method);
+  RequestSample begin();
+  void end(RouteMetrics *m, const RequestSample &sample);
+  void reject(RouteMetrics *m) {
+    if (m) m->rejected++;
+  }
+  void writePrometheus(Print &out);
+};
+
+uint32_t getLargestFreeBlock();
+
+extern RequestMetrics myMetrics;
+
+#endif  // SRC_METRICS_HPP_
+
+// EOF
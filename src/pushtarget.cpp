@@ -29,10 +29,13 @@ SOFTWARE.
 
 #include <battery.hpp>
 #include <config.hpp>
+#include <conntrace.hpp>
+#include <dnscache.hpp>
 #include <helper.hpp>
 #include <main.hpp>
 #include <perf.hpp>
 #include <pushtarget.hpp>
+#include <rtcmem.hpp>
 #include <templating.hpp>
 
 constexpr auto PUSHINT_FILENAME = "/push.dat";
@@ -115,15 +118,14 @@ void PushIntervalTracker::load() {
   File intFile = LittleFS.open(PUSHINT_FILENAME, "r");
 
   if (intFile) {
-    String line = intFile.readStringUntil('\n');
-    Log.notice(F("PUSH: Read interval tracker %s." CR), line.c_str());
-
     char temp[80];
     char *s, *p = &temp[0];
     int i = 0;
 
-    snprintf(&temp[0], sizeof(temp), "%s", line.c_str());
-    while ((s = strtok_r(p, ":", &p)) != NULL) {
+    temp[intFile.readBytesUntil('\n', &temp[0], sizeof(temp) - 1)] = 0;
+    Log.notice(F("PUSH: Read interval tracker %s." CR), &temp[0]);
+
+    while (i < 5 && (s = strtok_r(p, ":", &p)) != NULL) {
       _counters[i++] = atoi(s);
     }
 
@@ -168,119 +170,423 @@ GravmonPush::GravmonPush(GravmonConfig* gravmonConfig)
   _gravmonConfig = gravmonConfig;
 }
 
-void GravmonPush::sendAll(float angle, float gravitySG, float corrGravitySG,
-                          float tempC, float runTime) {
+bool GravmonPush::sendAll(float angle, float gravitySG, float corrGravitySG,
+                          float tempC, float runTime, float rawGravitySG,
+                          float rawTempC) {
   printHeap("PUSH");
   _http.setReuse(true);
   _httpSecure.setReuse(true);
 
   TemplatingEngine engine;
   setupTemplateEngine(engine, angle, gravitySG, corrGravitySG, tempC, runTime,
-                      myBatteryVoltage.getVoltage());
+                      myBatteryVoltage.getVoltage(), rawGravitySG, rawTempC);
 
   PushIntervalTracker intDelay;
   intDelay.load();
+  int sent = 0, failed = 0;
 
   if (myConfig.hasTargetHttpPost() && intDelay.useHttp1()) {
     PERF_BEGIN("push-http");
-    String tpl = getTemplate(GravmonPush::TEMPLATE_HTTP1);
-    String doc = engine.create(tpl.c_str());
-    sendHttpPost(doc);
+    String doc = engine.create(getTemplate(GravmonPush::TEMPLATE_HTTP1));
+    if (!send(GravmonPush::TEMPLATE_HTTP1, myConfig.getTargetHttpPost(), doc))
+      failed++;
+    sent++;
     PERF_END("push-http");
   }
 
   if (myConfig.hasTargetHttpPost2() && intDelay.useHttp2()) {
     PERF_BEGIN("push-http2");
-    String tpl = getTemplate(GravmonPush::TEMPLATE_HTTP2);
-    String doc = engine.create(tpl.c_str());
-    sendHttpPost2(doc);
+    String doc = engine.create(getTemplate(GravmonPush::TEMPLATE_HTTP2));
+    if (!send(GravmonPush::TEMPLATE_HTTP2, myConfig.getTargetHttpPost2(), doc))
+      failed++;
+    sent++;
     PERF_END("push-http2");
   }
 
   if (myConfig.hasTargetHttpGet() && intDelay.useHttp3()) {
     PERF_BEGIN("push-http3");
-    String tpl = getTemplate(GravmonPush::TEMPLATE_HTTP3);
-    String doc = engine.create(tpl.c_str());
-    sendHttpGet(doc);
+    String doc = engine.create(getTemplate(GravmonPush::TEMPLATE_HTTP3));
+    if (!send(GravmonPush::TEMPLATE_HTTP3, myConfig.getTargetHttpGet(), doc))
+      failed++;
+    sent++;
     PERF_END("push-http3");
   }
 
   if (myConfig.hasTargetInfluxDb2() && intDelay.useInflux()) {
     PERF_BEGIN("push-influxdb2");
-    String tpl = getTemplate(GravmonPush::TEMPLATE_INFLUX);
-    String doc = engine.create(tpl.c_str());
-    sendInfluxDb2(doc);
+    String doc = engine.create(getTemplate(GravmonPush::TEMPLATE_INFLUX));
+    if (!send(GravmonPush::TEMPLATE_INFLUX, myConfig.getTargetInfluxDB2(), doc))
+      failed++;
+    sent++;
     PERF_END("push-influxdb2");
   }
 
   if (myConfig.hasTargetMqtt() && intDelay.useMqtt()) {
     PERF_BEGIN("push-mqtt");
-    String tpl = getTemplate(GravmonPush::TEMPLATE_MQTT);
-    String doc = engine.create(tpl.c_str());
-    sendMqtt(doc);
+    String doc = engine.create(getTemplate(GravmonPush::TEMPLATE_MQTT));
+    if (!send(GravmonPush::TEMPLATE_MQTT, myConfig.getTargetMqtt(), doc))
+      failed++;
+    sent++;
     PERF_END("push-mqtt");
   }
 
   engine.freeMemory();
   intDelay.save();
+  Log.notice(F("PUSH: Largest template %d bytes." CR), _arena.peak());
+  clearTemplate();
+  return sent > 0 && failed == 0;
 }
 
-const char* GravmonPush::getTemplate(Templates t, bool useDefaultTemplate) {
-  String fname;
-  _baseTemplate.reserve(600);
+// Extracts host and port from a target url, a target without scheme is
+// treated as a host name (mqtt).
+bool parsePushTarget(const char* target, String& host, uint16_t& port) {
+  String url(target);
+  int start = url.indexOf("://");
+
+  port = 1883;
+
+  if (start >= 0) {
+    port = url.startsWith("https") ? 443 : 80;
+    start += 3;
+  } else {
+    start = 0;
+  }
+
+  int end = url.indexOf('/', start);
+  if (end < 0) end = url.length();
+
+  host = url.substring(start, end);
+  int colon = host.indexOf(':');
+
+  if (colon >= 0) {
+    port = host.substring(colon + 1).toInt();
+    host = host.substring(0, colon);
+  }
+
+  return host.length() > 0 && port > 0;
+}
+
+#if defined(ESP8266)
+// The session is copied to and from RTC memory as raw bytes
+static_assert(sizeof(BearSSL::Session) <= RTC_TLS_SESSION_SIZE,
+              "TLS session does not fit the RTC slot");
+
+// The fingerprint is part of the key, so a session that was validated
+// against an old pin is never resumed.
+static uint32_t tlsSessionKey(const String& host, uint16_t port,
+                              const char* fingerprint) {
+  uint32_t h = 2166136261u ^ port;
+
+  for (const char* p = host.c_str(); *p; p++) h = (h ^ *p) * 16777619u;
+  for (const char* p = fingerprint; *p; p++) h = (h ^ *p) * 16777619u;
+
+  return h ? h : 1;
+}
+#endif
+
+static const char* pushFingerprint(GravmonPush::Templates t) {
+  switch (t) {
+    case GravmonPush::TEMPLATE_HTTP1:
+      return myConfig.getHttpPostFingerprint();
+    case GravmonPush::TEMPLATE_HTTP2:
+      return myConfig.getHttpPost2Fingerprint();
+    case GravmonPush::TEMPLATE_HTTP3:
+      return myConfig.getHttpGetFingerprint();
+    case GravmonPush::TEMPLATE_INFLUX:
+      return myConfig.getInfluxDb2Fingerprint();
+    default:
+      return "";
+  }
+}
+
+// Prepares the tls client for an https target. The framework turns off
+// certificate checks for each send, so a pinned certificate is validated
+// here before the data is sent;
+//
+// - esp8266: a cached session is resumed so the key exchange is skipped.
+//   With a fingerprint a full handshake on a separate client validates the
+//   certificate once and the send may then only resume that session.
+// - esp32: there is no session api, the shared client is connected and
+//   validated here and the http client reuses the open connection.
+//
+// Returns false if the certificate does not match, the target is skipped.
+bool GravmonPush::beginSecure(const char* target, const char* fingerprint) {
+  String host;
+  uint16_t port;
+  bool pinned = strlen(fingerprint) > 0;
+
+#if defined(ESP8266)
+  _tlsKey = 0;
+  _tlsPinned = pinned;
+#endif
+
+  if (strncmp_P(target, PSTR("https://"), 8) ||
+      !parsePushTarget(target, host, port))
+    return true;
+
+#if defined(ESP8266)
+  _tlsKey = tlsSessionKey(host, port, fingerprint);
+  const uint8_t* cached = myRtcMemory.findTlsSession(_tlsKey);
+
+  if (cached) {
+    memcpy(reinterpret_cast<void*>(&_tlsSession), cached, sizeof(_tlsSession));
+  } else {
+    _tlsSession = BearSSL::Session();
+
+    if (pinned) {
+      BearSSL::WiFiClientSecure probe;
+      probe.setFingerprint(fingerprint);
+      probe.setSession(&_tlsSession);
+
+      if (!probe.connect(host.c_str(), port)) {
+        Log.error(F("PUSH: Certificate for %s could not be validated." CR),
+                  host.c_str());
+        _tlsKey = 0;
+        _lastSuccess = false;
+        _lastResponseCode = HTTPC_ERROR_CONNECTION_FAILED;
+        return false;
+      }
+
+      probe.stop();
+      myRtcMemory.storeTlsSession(_tlsKey, &_tlsSession, sizeof(_tlsSession));
+    }
+  }
+
+  _wifiSecure.setSession(&_tlsSession);
+#else
+  if (pinned) {
+    _wifiSecure.setInsecure();
+
+    if (!_wifiSecure.connect(host.c_str(), port) ||
+        !_wifiSecure.verify(fingerprint, nullptr)) {
+      Log.error(F("PUSH: Certificate for %s could not be validated." CR),
+                host.c_str());
+      _wifiSecure.stop();
+      _lastSuccess = false;
+      _lastResponseCode = HTTPC_ERROR_CONNECTION_FAILED;
+      return false;
+    }
+  }
+#endif
+
+  return true;
+}
+
+// Keeps the session for the next push, a failed push drops it so the next
+// one starts with a full handshake.
+void GravmonPush::endSecure() {
+#if defined(ESP8266)
+  if (!_tlsKey) return;
+
+  _wifiSecure.setSession(nullptr);
+
+  if (_tlsPinned) {
+    // A server that did not resume gave us an unvalidated certificate
+    const uint8_t* cached = myRtcMemory.findTlsSession(_tlsKey);
+
+    if (!cached || memcmp(cached, &_tlsSession, sizeof(_tlsSession))) {
+      Log.warning(F("PUSH: Pinned session was not resumed, dropping it." CR));
+      myRtcMemory.removeTlsSession(_tlsKey);
+    } else if (!_lastSuccess) {
+      myRtcMemory.removeTlsSession(_tlsKey);
+    }
+  } else if (_lastSuccess) {
+    myRtcMemory.storeTlsSession(_tlsKey, &_tlsSession, sizeof(_tlsSession));
+  } else {
+    myRtcMemory.removeTlsSession(_tlsKey);
+  }
+
+  _tlsKey = 0;
+#endif
+}
+
+// Sends the document to one target. The address of the target can come from
+// the dns cache, if the connection fails the entry is dropped and the push is
+// retried once with a fresh lookup. Http requests are only retried when the
+// connection failed so nothing is delivered twice.
+bool GravmonPush::send(Templates t, const char* target, const String& doc) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    myDnsCache.begin(attempt == 0);
+
+    if (beginSecure(target, pushFingerprint(t))) {
+      switch (t) {
+        case TEMPLATE_HTTP1:
+          sendHttpPost(doc);
+          break;
+        case TEMPLATE_HTTP2:
+          sendHttpPost2(doc);
+          break;
+        case TEMPLATE_HTTP3:
+          sendHttpGet(doc);
+          break;
+        case TEMPLATE_INFLUX:
+          sendInfluxDb2(doc);
+          break;
+        case TEMPLATE_MQTT:
+          sendMqtt(doc);
+          break;
+        default:
+          break;
+      }
+
+      endSecure();
+    }
+
+    bool retry = myDnsCache.isHit() && !_lastSuccess &&
+                 (t == TEMPLATE_MQTT ||
+                  _lastResponseCode == HTTPC_ERROR_CONNECTION_FAILED);
+
+    if (retry) myDnsCache.removeHit();
+
+    myDnsCache.end();
+
+    if (!retry) break;
+
+    Log.notice(F("PUSH: Connection to cached address failed, retrying." CR));
+  }
+
+  return _lastSuccess;
+}
+
+// Push to a single target and measure where the time is spent. Name lookup
+// and tcp connect are measured with a separate probe connection before the
+// data is sent, so the send time also includes tls, request and response.
+void GravmonPush::sendTarget(Templates t, TemplatingEngine& engine,
+                             PushTiming& timing) {
+  const char* target = "";
 
-  // Load templates from memory
   switch (t) {
     case TEMPLATE_HTTP1:
-      _baseTemplate = String(iSpindleFormat);
-      fname = TPL_FNAME_POST;
+      timing.enabled = myConfig.hasTargetHttpPost();
+      target = myConfig.getTargetHttpPost();
       break;
     case TEMPLATE_HTTP2:
-      _baseTemplate = String(iSpindleFormat);
-      fname = TPL_FNAME_POST2;
+      timing.enabled = myConfig.hasTargetHttpPost2();
+      target = myConfig.getTargetHttpPost2();
       break;
     case TEMPLATE_HTTP3:
-      _baseTemplate = String(iHttpGetFormat);
-      fname = TPL_FNAME_GET;
+      timing.enabled = myConfig.hasTargetHttpGet();
+      target = myConfig.getTargetHttpGet();
       break;
     case TEMPLATE_INFLUX:
-      _baseTemplate = String(influxDbFormat);
-      fname = TPL_FNAME_INFLUXDB;
+      timing.enabled = myConfig.hasTargetInfluxDb2();
+      target = myConfig.getTargetInfluxDB2();
       break;
     case TEMPLATE_MQTT:
-      _baseTemplate = String(mqttFormat);
-      fname = TPL_FNAME_MQTT;
+      timing.enabled = myConfig.hasTargetMqtt();
+      target = myConfig.getTargetMqtt();
       break;
-    case TEMPLATE_BLE:
-      _baseTemplate = String(bleFormat);
-      fname =
-          "/dummy";  // this file should not exist, use standard template only
+    default:
       break;
   }
 
+  if (!timing.enabled) return;
+
+  uint32_t start = millis();
+  String doc = engine.create(getTemplate(t));
+  timing.render = millis() - start;
+
+  // The phases are taken from the connection made by the push itself
+  myConnTrace.begin();
+  start = millis();
+  send(t, target, doc);
+  uint32_t end = millis();
+  myConnTrace.end();
+
+  timing.send = end - start;
+  timing.success = _lastSuccess;
+  timing.code = _lastResponseCode;
+
+  if (myConnTrace.isTraced()) {
+    bool secure = !strncmp_P(target, PSTR("https://"), 8);
+
+    timing.dns = myConnTrace.getDnsTime();
+    timing.connect = myConnTrace.getConnectTime();
+    timing.tls = myConnTrace.getTlsTime(secure);
+    timing.request = myConnTrace.getRequestTime(secure);
+    timing.response = myConnTrace.getResponseTime(end);
+  }
+
+  Log.notice(F("PUSH: Target %d, render %d, dns %d, connect %d, tls %d, "
+               "request %d, response %d, send %d ms." CR),
+             t, timing.render, timing.dns, timing.connect, timing.tls,
+             timing.request, timing.response, timing.send);
+}
+
+// The template is valid until the next call or until clearTemplate()
+const char* GravmonPush::getTemplate(Templates t, bool useDefaultTemplate) {
+  switch (t) {
+    case TEMPLATE_HTTP1:
+      return loadTemplate(TPL_FNAME_POST, iSpindleFormat, useDefaultTemplate);
+    case TEMPLATE_HTTP2:
+      return loadTemplate(TPL_FNAME_POST2, iSpindleFormat, useDefaultTemplate);
+    case TEMPLATE_HTTP3:
+      return loadTemplate(TPL_FNAME_GET, iHttpGetFormat, useDefaultTemplate);
+    case TEMPLATE_INFLUX:
+      return loadTemplate(TPL_FNAME_INFLUXDB, influxDbFormat,
+                          useDefaultTemplate);
+    case TEMPLATE_MQTT:
+      return loadTemplate(TPL_FNAME_MQTT, mqttFormat, useDefaultTemplate);
+    case TEMPLATE_BLE:  // Only the standard template is used
+      break;
+  }
+
+  return loadTemplate(nullptr, bleFormat, true);
+}
+
+// Loads the template into the push arena, which is sized to the template so
+// it takes one exact allocation. The rendered body and the response are
+// owned by the framework (TemplatingEngine and the http clients in BasePush),
+// they don't take a caller buffer so they can't be placed in the arena.
+const char* GravmonPush::loadTemplate(const char* fname,
+                                      const char* defaultTemplate,
+                                      bool useDefaultTemplate) {
+  const char* tpl = nullptr;
+  char* buf;
+
+  clearTemplate();
+
   if (!useDefaultTemplate) {
     File file = LittleFS.open(fname, "r");
+
     if (file) {
-      char buf[file.size() + 1];
-      memset(&buf[0], 0, file.size() + 1);
-      file.readBytes(&buf[0], file.size());
-      _baseTemplate = String(&buf[0]);
+      size_t size = file.size();
+
+      if (_arena.reserve(size + 1)) {
+        buf = static_cast<char*>(_arena.alloc(size + 1));
+        buf[file.readBytes(buf, size)] = 0;
+        tpl = buf;
+        Log.notice(F("PUSH: Template loaded from disk %s." CR), fname);
+      }
+
       file.close();
-      Log.notice(F("PUSH: Template loaded from disk %s." CR), fname.c_str());
+    }
+  }
+
+  if (!tpl) {
+    size_t size = strlen_P(defaultTemplate);
+
+    if (_arena.reserve(size + 1)) {
+      buf = static_cast<char*>(_arena.alloc(size + 1));
+      strcpy_P(buf, defaultTemplate);
+      tpl = buf;
+    } else {
+      Log.error(F("PUSH: Not enough memory for the template." CR));
+      tpl = "";
     }
   }
 
 #if LOG_LEVEL == 6
-  Log.verbose(F("TPL : Base '%s'." CR), _baseTemplate.c_str());
+  Log.verbose(F("TPL : Base '%s'." CR), tpl);
 #endif
 
-  return _baseTemplate.c_str();
+  return tpl;
 }
 
 void GravmonPush::setupTemplateEngine(TemplatingEngine& engine, float angle,
                                       float gravitySG, float corrGravitySG,
-                                      float tempC, float runTime,
-                                      float voltage) {
+                                      float tempC, float runTime, float voltage,
+                                      float rawGravitySG, float rawTempC) {
   // Names
   engine.setVal(TPL_MDNS, myConfig.getMDNS());
   engine.setVal(TPL_ID, myConfig.getID());
@@ -294,6 +600,15 @@ void GravmonPush::setupTemplateEngine(TemplatingEngine& engine, float angle,
     engine.setVal(TPL_TEMP, convertCtoF(tempC), DECIMALS_TEMP);
   }
 
+  // Temperature before and after filtering
+  if (myConfig.isTempFormatC()) {
+    engine.setVal(TPL_TEMP_RAW, rawTempC, DECIMALS_TEMP);
+    engine.setVal(TPL_TEMP_FILTERED, tempC, DECIMALS_TEMP);
+  } else {
+    engine.setVal(TPL_TEMP_RAW, convertCtoF(rawTempC), DECIMALS_TEMP);
+    engine.setVal(TPL_TEMP_FILTERED, convertCtoF(tempC), DECIMALS_TEMP);
+  }
+
   engine.setVal(TPL_TEMP_C, tempC, DECIMALS_TEMP);
   engine.setVal(TPL_TEMP_F, convertCtoF(tempC), DECIMALS_TEMP);
   engine.setVal(TPL_TEMP_UNITS, myConfig.getTempFormat());
@@ -341,10 +656,16 @@ void GravmonPush::setupTemplateEngine(TemplatingEngine& engine, float angle,
   if (myConfig.isGravitySG()) {
     engine.setVal(TPL_GRAVITY, gravitySG, DECIMALS_SG);
     engine.setVal(TPL_GRAVITY_CORR, corrGravitySG, DECIMALS_SG);
+    engine.setVal(TPL_GRAVITY_RAW, rawGravitySG, DECIMALS_SG);
+    engine.setVal(TPL_GRAVITY_FILTERED, gravitySG, DECIMALS_SG);
   } else {
     engine.setVal(TPL_GRAVITY, convertToPlato(gravitySG), DECIMALS_PLATO);
     engine.setVal(TPL_GRAVITY_CORR, convertToPlato(corrGravitySG),
                   DECIMALS_PLATO);
+    engine.setVal(TPL_GRAVITY_RAW, convertToPlato(rawGravitySG),
+                  DECIMALS_PLATO);
+    engine.setVal(TPL_GRAVITY_FILTERED, convertToPlato(gravitySG),
+                  DECIMALS_PLATO);
   }
 
   engine.setVal(TPL_GRAVITY_G, gravitySG, DECIMALS_SG);
@@ -24,6 +24,11 @@ SOFTWARE.
 #ifndef SRC_PUSHTARGET_HPP_
 #define SRC_PUSHTARGET_HPP_
 
+#if defined(ESP8266)
+#include <WiFiClientSecure.h>
+#endif
+
+#include <arena.hpp>
 #include <basepush.hpp>
 #include <templating.hpp>
 
@@ -49,6 +54,10 @@ constexpr auto TPL_GRAVITY_CORR = "${corr-gravity}";
 constexpr auto TPL_GRAVITY_CORR_G = "${corr-gravity-sg}";
 constexpr auto TPL_GRAVITY_CORR_P = "${corr-gravity-plato}";
 constexpr auto TPL_GRAVITY_UNIT = "${gravity-unit}";  // G or P
+constexpr auto TPL_GRAVITY_RAW = "${gravity-raw}";
+constexpr auto TPL_GRAVITY_FILTERED = "${gravity-filtered}";
+constexpr auto TPL_TEMP_RAW = "${temp-raw}";
+constexpr auto TPL_TEMP_FILTERED = "${temp-filtered}";
 constexpr auto TPL_APP_VER = "${app-ver}";
 constexpr auto TPL_APP_BUILD = "${app-build}";
 
@@ -63,14 +72,24 @@ extern const char iHttpGetFormat[] PROGMEM;
 extern const char influxDbFormat[] PROGMEM;
 extern const char mqttFormat[] PROGMEM;
 
-class GravmonPush : public BasePush {
- private:
-  GravmonConfig* _gravmonConfig;
-  String _baseTemplate;
+// Time spent in each stage when a target is tested, in ms
+struct PushTiming {
+  bool enabled = false;
+  bool success = false;
+  int code = 0;
+  uint32_t render = 0;
+  uint32_t dns = 0;
+  uint32_t connect = 0;
+  uint32_t tls = 0;
+  uint32_t request = 0;
+  uint32_t response = 0;
+  uint32_t send = 0;
+};
 
- public:
-  explicit GravmonPush(GravmonConfig* gravmonConfig);
+bool parsePushTarget(const char* target, String& host, uint16_t& port);
 
+class GravmonPush : public BasePush {
+ public:
   enum Templates {
     TEMPLATE_HTTP1 = 0,
     TEMPLATE_HTTP2 = 1,
@@ -80,14 +99,42 @@ class GravmonPush : public BasePush {
     TEMPLATE_BLE = 5
   };
 
-  void sendAll(float angle, float gravitySG, float corrGravitySG, float tempC,
-               float runTime);
+ private:
+  GravmonConfig* _gravmonConfig;
+  Arena _arena;  // Sized to the loaded template
+#if defined(ESP8266)
+  BearSSL::Session _tlsSession;
+  uint32_t _tlsKey = 0;
+  bool _tlsPinned = false;
+#endif
+
+  bool beginSecure(const char* target, const char* fingerprint);
+  void endSecure();
+  bool send(Templates t, const char* target, const String& doc);
+  const char* loadTemplate(const char* fname, const char* defaultTemplate,
+                           bool useDefaultTemplate);
+
+ public:
+  explicit GravmonPush(GravmonConfig* gravmonConfig);
+
+  // Returns true when at least one target was sent and all of them succeeded
+  bool sendAll(float angle, float gravitySG, float corrGravitySG, float tempC,
+               float runTime, float rawGravitySG, float rawTempC);
+
+  void sendTarget(Templates t, TemplatingEngine& engine, PushTiming& timing);
 
   const char* getTemplate(Templates t, bool useDefaultTemplate = false);
-  void clearTemplate() { _baseTemplate.clear(); }
+  void clearTemplate() { _arena.reserve(0); }
+  void setupTemplateEngine(TemplatingEngine& engine, float angle,
+                           float gravitySG, float corrGravitySG, float tempC,
+                           float runTime, float voltage, float rawGravitySG,
+                           float rawTempC);
   void setupTemplateEngine(TemplatingEngine& engine, float angle,
                            float gravitySG, float corrGravitySG, float tempC,
-                           float runTime, float voltage);
+                           float runTime, float voltage) {
+    setupTemplateEngine(engine, angle, gravitySG, corrGravitySG, tempC,
+                        runTime, voltage, gravitySG, tempC);
+  }
   int getLastCode() { return _lastResponseCode; }
   bool getLastSuccess() { return _lastSuccess; }
 };
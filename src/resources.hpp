@@ -39,6 +39,7 @@ constexpr auto PARAM_GRAVITY_TEMP_ADJ = "gravity_temp_adjustment";
 constexpr auto PARAM_TEMP_ADJ = "temp_adjustment_value";
 constexpr auto PARAM_GYRO_CALIBRATION = "gyro_calibration_data";
 constexpr auto PARAM_GYRO_TEMP = "gyro_temp";
+constexpr auto PARAM_GYRO_SCALE = "gyro_scale_data";
 constexpr auto PARAM_GYRO_DISABLED = "gyro_disabled";
 constexpr auto PARAM_STORAGE_SLEEP = "storage_sleep";
 constexpr auto PARAM_VOLTAGE_PIN = "voltage_pin";
@@ -67,6 +68,30 @@ constexpr auto PARAM_PUSH_INTERVAL_INFLUX = "influxdb2_int";
 constexpr auto PARAM_PUSH_INTERVAL_MQTT = "mqtt_int";
 constexpr auto PARAM_IGNORE_LOW_ANGLES = "ignore_low_angles";
 constexpr auto PARAM_BATTERY_SAVING = "battery_saving";
+constexpr auto PARAM_PUSH_DEADBAND_GRAVITY = "push_deadband_gravity";
+constexpr auto PARAM_PUSH_DEADBAND_TEMP = "push_deadband_temp";
+constexpr auto PARAM_PUSH_MAX_SILENCE = "push_max_silence";
+constexpr auto PARAM_SLEEP_ADAPTIVE = "sleep_adaptive";
+constexpr auto PARAM_SLEEP_INTERVAL_MIN = "sleep_interval_min";
+constexpr auto PARAM_SLEEP_INTERVAL_MAX = "sleep_interval_max";
+constexpr auto PARAM_GRAVITY_FILTER = "gravity_filter";
+constexpr auto PARAM_GYRO_FUSION = "gyro_fusion";
+constexpr auto PARAM_GYRO_STILL_TIME = "gyro_still_time";
+constexpr auto PARAM_GRAVITY_LOOKUP = "gravity_lookup";
+constexpr auto PARAM_CALIBRATION_STEP = "step";
+constexpr auto PARAM_CALIBRATION_STEPS_DONE = "steps_done";
+constexpr auto PARAM_PROGRESS = "progress";
+constexpr auto PARAM_JOB_ID = "job_id";
+constexpr auto PARAM_JOB_NAME = "job_name";
+constexpr auto PARAM_JOB_STATE = "job_state";
+constexpr auto PARAM_JOB_DURATION = "job_duration";
+constexpr auto PARAM_JOB_RESULT = "job_result";
+constexpr auto PARAM_CHANGED = "changed";
+constexpr auto PARAM_HTTP_POST_FINGERPRINT = "http_push_fingerprint";
+constexpr auto PARAM_HTTP_POST2_FINGERPRINT = "http_push2_fingerprint";
+constexpr auto PARAM_HTTP_GET_FINGERPRINT = "http_push3_fingerprint";
+constexpr auto PARAM_INFLUXDB2_FINGERPRINT = "influxdb2_fingerprint";
+constexpr auto PARAM_CALIBRATION_POINTS = "calibration_points";
 constexpr auto PARAM_FORMAT_POST = "http_post_format";
 constexpr auto PARAM_FORMAT_POST2 = "http_post2_format";
 constexpr auto PARAM_FORMAT_GET = "http_get_format";
@@ -75,6 +100,15 @@ constexpr auto PARAM_FORMAT_MQTT = "mqtt_format";
 constexpr auto PARAM_PUSH_FORMAT = "push_format";
 constexpr auto PARAM_PUSH_RETURN_CODE = "push_return_code";
 constexpr auto PARAM_PUSH_ENABLED = "push_enabled";
+constexpr auto PARAM_PUSH_ALL = "all";
+constexpr auto PARAM_PUSH_TARGETS = "push_targets";
+constexpr auto PARAM_PUSH_TIME_RENDER = "render_time";
+constexpr auto PARAM_PUSH_TIME_DNS = "dns_time";
+constexpr auto PARAM_PUSH_TIME_CONNECT = "connect_time";
+constexpr auto PARAM_PUSH_TIME_TLS = "tls_time";
+constexpr auto PARAM_PUSH_TIME_REQUEST = "request_time";
+constexpr auto PARAM_PUSH_TIME_RESPONSE = "response_time";
+constexpr auto PARAM_PUSH_TIME_SEND = "send_time";
 constexpr auto PARAM_SELF = "self_check";
 constexpr auto PARAM_SELF_GYRO_CONNECTED = "gyro_connected";
 constexpr auto PARAM_SELF_GYRO_CALIBRATION = "gyro_calibration";
@@ -0,0 +1,194 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <log.hpp>
+#include <main.hpp>
+#include <rtcmem.hpp>
+
+constexpr uint32_t RTC_MAGIC = 0x47524156;  // GRAV
+
+RtcMemory myRtcMemory;
+
+#if !defined(ESP8266)
+RTC_DATA_ATTR RtcData rtcData;
+#endif
+
+uint32_t RtcMemory::calculateCrc() {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(&_data) +
+                     offsetof(RtcData, crc) + sizeof(_data.crc);
+  size_t len = sizeof(RtcData) - offsetof(RtcData, crc) - sizeof(_data.crc);
+  uint32_t crc = 0xffffffff;
+
+  while (len--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+  }
+
+  return ~crc;
+}
+
+void RtcMemory::load() {
+#if defined(ESP8266)
+  ESP.rtcUserMemoryRead(RTC_MEMORY_OFFSET, reinterpret_cast<uint32_t *>(&_data),
+                        sizeof(_data));
+#else
+  memcpy(&_data, &rtcData, sizeof(_data));
+#endif
+
+  _valid = (_data.magic == RTC_MAGIC) && (_data.crc == calculateCrc());
+
+  if (!_valid) {
+    Log.notice(F("RTC : No valid data found in RTC memory." CR));
+    clear();
+  }
+
+#if LOG_LEVEL == 6
+  Log.verbose(F("RTC : Last push gravity=%F, temp=%F, age=%ds." CR),
+              _data.lastPushGravitySG, _data.lastPushTempC,
+              _data.secondsSincePush);
+#endif
+}
+
+void RtcMemory::save() {
+  _data.magic = RTC_MAGIC;
+  _data.crc = calculateCrc();
+  _valid = true;
+
+#if defined(ESP8266)
+  ESP.rtcUserMemoryWrite(RTC_MEMORY_OFFSET,
+                         reinterpret_cast<uint32_t *>(&_data), sizeof(_data));
+#else
+  memcpy(&rtcData, &_data, sizeof(_data));
+#endif
+}
+
+void RtcMemory::clear() {
+  memset(&_data, 0, sizeof(_data));
+  _valid = false;
+}
+
+void RtcMemory::setLastPush(float gravitySG, float tempC) {
+  _data.lastPushGravitySG = gravitySG;
+  _data.lastPushTempC = tempC;
+  _data.secondsSincePush = 0;
+}
+
+void RtcMemory::addElapsedTime(uint32_t seconds) {
+  _data.secondsSincePush += seconds;
+  _data.elapsedTime += seconds;
+}
+
+void RtcMemory::addGravity(float gravitySG) {
+  _data.gravityHistory[_data.gravityIndex] = gravitySG;
+  _data.gravityTime[_data.gravityIndex] = _data.elapsedTime;
+  _data.gravityIndex = (_data.gravityIndex + 1) % RTC_GRAVITY_HISTORY;
+
+  if (_data.gravityCount < RTC_GRAVITY_HISTORY) _data.gravityCount++;
+}
+
+const uint8_t *RtcMemory::findTlsSession(uint32_t key) {
+  for (auto &slot : _data.tlsSessions) {
+    if (key && slot.key == key) {
+      slot.lastUsed = ++_data.tlsCounter;
+      return &slot.data[0];
+    }
+  }
+
+  return nullptr;
+}
+
+// Replaces the session for the same key or the least recently used one
+void RtcMemory::storeTlsSession(uint32_t key, const void *data, size_t len) {
+  TlsSessionSlot *use = &_data.tlsSessions[0];
+
+  if (!key || len > sizeof(use->data)) return;
+
+  for (auto &slot : _data.tlsSessions) {
+    if (slot.key == key) {
+      use = &slot;
+      break;
+    }
+
+    if (slot.lastUsed < use->lastUsed) use = &slot;
+  }
+
+  use->key = key;
+  use->lastUsed = ++_data.tlsCounter;
+  memset(&use->data[0], 0, sizeof(use->data));
+  memcpy(&use->data[0], data, len);
+}
+
+void RtcMemory::removeTlsSession(uint32_t key) {
+  for (auto &slot : _data.tlsSessions) {
+    if (key && slot.key == key) memset(&slot, 0, sizeof(slot));
+  }
+}
+
+bool RtcMemory::findDnsEntry(uint32_t key, uint32_t &ip) {
+  if (!key || getElapsedTime() >= _data.dnsExpires) return false;
+
+  for (const auto &entry : _data.dnsCache) {
+    if (entry.key == key) {
+      ip = entry.ip;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Replaces the entry for the same key or a free one, the oldest entry is
+// dropped when the cache is full. An expired cache is cleared first.
+void RtcMemory::storeDnsEntry(uint32_t key, uint32_t ip, uint32_t ttl) {
+  uint32_t now = getElapsedTime();
+  DnsCacheEntry *use = nullptr;
+
+  if (!key) return;
+
+  if (now >= _data.dnsExpires) {
+    memset(&_data.dnsCache[0], 0, sizeof(_data.dnsCache));
+    _data.dnsExpires = now + ttl;
+  }
+
+  for (auto &entry : _data.dnsCache) {
+    if (entry.key == key || (!use && !entry.key)) use = &entry;
+    if (entry.key == key) break;
+  }
+
+  if (!use) {
+    memmove(&_data.dnsCache[0], &_data.dnsCache[1],
+            sizeof(_data.dnsCache) - sizeof(_data.dnsCache[0]));
+    use = &_data.dnsCache[RTC_DNS_ENTRIES - 1];
+  }
+
+  use->key = key;
+  use->ip = ip;
+}
+
+void RtcMemory::removeDnsEntry(uint32_t key) {
+  for (auto &entry : _data.dnsCache) {
+    if (key && entry.key == key) memset(&entry, 0, sizeof(entry));
+  }
+}
+
+// EOF
@@ -0,0 +1,153 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#ifndef SRC_RTCMEM_HPP_
+#define SRC_RTCMEM_HPP_
+
+#include <Arduino.h>
+
+constexpr auto RTC_GRAVITY_HISTORY = 8;
+constexpr auto RTC_TLS_SESSIONS = 2;
+constexpr auto RTC_TLS_SESSION_SIZE = 88;  // sizeof(BearSSL::Session)
+constexpr auto RTC_GRAVITY_TABLE_WINDOW = 8;
+constexpr auto RTC_DNS_ENTRIES = 3;
+
+// State for a 1D kalman filter, a variance of 0 means that the filter has no
+// value yet.
+struct FilterState {
+  float value;
+  float variance;
+};
+
+// Opaque tls session parameters for one host, a key of 0 means unused.
+struct TlsSessionSlot {
+  uint32_t key;
+  uint32_t lastUsed;
+  uint8_t data[RTC_TLS_SESSION_SIZE];
+};
+
+// Resolved ipv4 address for a host, a key of 0 means unused.
+struct DnsCacheEntry {
+  uint32_t key;
+  uint32_t ip;
+};
+
+// Entries of the gravity table around the last angle (see gravitytable.hpp),
+// a count below 2 means that there is no table for the formula.
+struct GravityTableWindow {
+  uint32_t formulaHash;  // 0 if nothing is loaded
+  int32_t start;
+  int32_t step;
+  uint16_t count;  // Entries in the table
+  uint16_t first;  // Table index of entry[0]
+  int32_t entry[RTC_GRAVITY_TABLE_WINDOW];
+};
+
+// Data that is kept in RTC memory between deep sleep cycles. The content is
+// lost on power loss so everything stored here must have a sane fallback.
+struct RtcData {
+  uint32_t magic;
+  uint32_t crc;  // Covers everything after this field
+
+  // Unfiltered values from the last successful push to a wifi target
+  float lastPushGravitySG;
+  float lastPushTempC;
+  uint32_t secondsSincePush;
+
+  // Recent gravity readings, used to estimate the fermentation activity
+  uint32_t elapsedTime;  // seconds, accumulated over wake cycles
+  float gravityHistory[RTC_GRAVITY_HISTORY];
+  uint32_t gravityTime[RTC_GRAVITY_HISTORY];
+  uint8_t gravityCount;
+  uint8_t gravityIndex;
+
+  // Filtered gravity and temperature
+  FilterState gravityFilter;
+  FilterState tempFilter;
+
+  // Tls sessions that can be resumed on the next push
+  uint32_t tlsCounter;
+  TlsSessionSlot tlsSessions[RTC_TLS_SESSIONS];
+
+  GravityTableWindow gravityTable;
+
+  // Addresses of the push targets, all entries expire together at dnsExpires
+  // (elapsed seconds) so that none is older than the ttl.
+  uint32_t dnsExpires;
+  DnsCacheEntry dnsCache[RTC_DNS_ENTRIES];
+};
+
+// ESP8266 reserves the first part of the user memory for other features
+// (double reset detection), so we place our data after that.
+constexpr auto RTC_MEMORY_OFFSET = 32;  // 4 byte blocks
+
+#if defined(ESP8266)
+static_assert(sizeof(RtcData) <= 512 - RTC_MEMORY_OFFSET * 4,
+              "RtcData does not fit in the RTC user memory");
+#endif
+
+class RtcMemory {
+ private:
+  RtcData _data;
+  bool _valid = false;
+
+  uint32_t calculateCrc();
+
+ public:
+  void load();
+  void save();
+  void clear();
+
+  bool isValid() { return _valid; }
+
+  bool hasLastPush() { return _data.lastPushGravitySG != 0; }
+  float getLastPushGravitySG() { return _data.lastPushGravitySG; }
+  float getLastPushTempC() { return _data.lastPushTempC; }
+  uint32_t getSecondsSincePush() { return _data.secondsSincePush; }
+  void setLastPush(float gravitySG, float tempC);
+  void addElapsedTime(uint32_t seconds);
+  uint32_t getElapsedTime() { return _data.elapsedTime + millis() / 1000; }
+
+  void addGravity(float gravitySG);
+  int getGravityHistoryCount() { return _data.gravityCount; }
+  const float* getGravityHistory() { return &_data.gravityHistory[0]; }
+  const uint32_t* getGravityHistoryTime() { return &_data.gravityTime[0]; }
+
+  FilterState& getGravityFilter() { return _data.gravityFilter; }
+  FilterState& getTempFilter() { return _data.tempFilter; }
+  GravityTableWindow& getGravityTableWindow() { return _data.gravityTable; }
+
+  const uint8_t* findTlsSession(uint32_t key);
+  void storeTlsSession(uint32_t key, const void* data, size_t len);
+  void removeTlsSession(uint32_t key);
+
+  bool findDnsEntry(uint32_t key, uint32_t& ip);
+  void storeDnsEntry(uint32_t key, uint32_t ip, uint32_t ttl);
+  void removeDnsEntry(uint32_t key);
+};
+
+extern RtcMemory myRtcMemory;
+
+#endif  // SRC_RTCMEM_HPP_
+
+// EOF
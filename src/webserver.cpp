@@ -23,13 +23,22 @@ SOFTWARE.
  */
 #include <Wire.h>
 
+#include <memory>
+
+#include <admission.hpp>
+#include <allocprof.hpp>
+#include <assets.hpp>
 #include <battery.hpp>
 #include <calc.hpp>
+#include <calibration.hpp>
 #include <config.hpp>
+#include <gravitytable.hpp>
 #include <gyro.hpp>
 #include <helper.hpp>
 #include <history.hpp>
+#include <job.hpp>
 #include <main.hpp>
+#include <metrics.hpp>
 #include <perf.hpp>
 #include <pushtarget.hpp>
 #include <resources.hpp>
@@ -71,17 +80,24 @@ void GravmonWebServer::webHandleConfigWrite(AsyncWebServerRequest *request,
 
   PERF_BEGIN("webserver-api-config-write");
   Log.notice(F("WEB : webServer callback for /api/config(write)." CR));
+  // Only the supplied keys are applied (merge patch), flash is only written
+  // if the resulting configuration differs from the stored one.
   JsonObject obj = json.as<JsonObject>();
   myConfig.parseJson(obj);
   obj.clear();
-  myConfig.saveFile();
+  bool changed;
+  bool success = myConfig.saveFile(&changed);
+  if (changed) myGravityTable.update();
   myBatteryVoltage.read();
 
   AsyncJsonResponse *response =
       new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
   obj = response->getRoot().as<JsonObject>();
-  obj[PARAM_SUCCESS] = true;
-  obj[PARAM_MESSAGE] = "Configuration updated";
+  obj[PARAM_SUCCESS] = success;
+  obj[PARAM_CHANGED] = changed;
+  obj[PARAM_MESSAGE] = !success  ? "Failed to save configuration"
+                       : changed ? "Configuration updated"
+                                 : "Configuration unchanged";
   response->setLength();
   request->send(response);
   PERF_END("webserver-api-config-write");
@@ -94,17 +110,96 @@ void GravmonWebServer::webHandleCalibrate(AsyncWebServerRequest *request) {
 
   PERF_BEGIN("webserver-api-calibrate");
   Log.notice(F("WEB : webServer callback for /api/calibrate." CR));
-  _sensorCalibrationTask = true;
+
   AsyncJsonResponse *response =
       new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
   JsonObject obj = response->getRoot().as<JsonObject>();
-  obj[PARAM_SUCCESS] = true;
-  obj[PARAM_MESSAGE] = "Scheduled device calibration";
+
+  if (myJobs.isActive(_sensorCalibrationJob)) {
+    obj[PARAM_SUCCESS] = true;
+    obj[PARAM_MESSAGE] = "Device calibration is already running";
+  } else {
+    // With a step the six position calibration is used, otherwise the offsets
+    // are calibrated with the device lying flat.
+    int step = -1;
+    if (request->hasParam(PARAM_CALIBRATION_STEP))
+      step = request->getParam(PARAM_CALIBRATION_STEP)->value().toInt();
+
+    _sensorCalibrationStep = step;
+    _sensorCalibrationJob = myJobs.submit("calibrate", [this, step](Job &job) {
+      return runCalibration(job, step);
+    });
+    obj[PARAM_SUCCESS] = _sensorCalibrationJob != JOB_INVALID_ID;
+    obj[PARAM_MESSAGE] = _sensorCalibrationJob != JOB_INVALID_ID
+                             ? "Scheduled device calibration"
+                             : "Unable to schedule device calibration";
+  }
+
+  obj[PARAM_JOB_ID] = _sensorCalibrationJob;
   response->setLength();
   request->send(response);
   PERF_END("webserver-api-calibrate");
 }
 
+bool GravmonWebServer::runCalibration(Job &job, int step) {
+  if (job.cancelled) {
+    myGyro.cancelCalibration();
+    return true;
+  }
+
+  DynamicJsonDocument doc(JSON_BUFFER_SIZE_S);
+  JsonObject obj = doc.to<JsonObject>();
+  obj[PARAM_STATUS] = false;
+
+  if (step >= 0) {
+    int result = myGyro.calibratePosition(step);
+    job.progress = myGyro.getPositionProgress();
+
+    if (result == GYRO_CAL_RUNNING) return false;
+
+    job.success = result >= 0;
+
+    obj[PARAM_CALIBRATION_STEP] = step;
+    obj[PARAM_CALIBRATION_STEPS_DONE] = myGyro.getCalibratedPositions();
+
+    switch (result) {
+      case GYRO_CAL_CAPTURED:
+        obj[PARAM_MESSAGE] = "Position captured";
+        break;
+      case GYRO_CAL_COMPLETED:
+        obj[PARAM_MESSAGE] = "Six position calibration completed";
+        break;
+      case GYRO_CAL_WRONG_POSITION:
+        obj[PARAM_MESSAGE] = "Device is not in the position for this step";
+        break;
+      default:
+        obj[PARAM_MESSAGE] = "Calibration failed, device moving or no gyro";
+        break;
+    }
+  } else if (myGyro.isConnected()) {
+    // The offset calibration is done in small steps so the web server and
+    // wifi stack are not blocked while it runs.
+    if (!myGyro.isCalibrationRunning()) myGyro.beginCalibration();
+
+    bool done = myGyro.stepCalibration();
+    job.progress = myGyro.getCalibrationProgress();
+
+    if (!done) return false;
+
+    job.success = true;
+    obj[PARAM_PROGRESS] = job.progress;
+    obj[PARAM_MESSAGE] = "Calibration completed";
+  } else {
+    Log.error(F("WEB : No gyro connected, skipping calibration" CR));
+    job.success = false;
+    obj[PARAM_MESSAGE] = "Calibration failed, no gyro connected";
+  }
+
+  obj[PARAM_SUCCESS] = job.success;
+  serializeJson(obj, job.result);
+  return true;
+}
+
 void GravmonWebServer::webHandleCalibrateStatus(
     AsyncWebServerRequest *request) {
   if (!isAuthenticated(request)) {
@@ -113,26 +208,146 @@ void GravmonWebServer::webHandleCalibrateStatus(
 
   PERF_BEGIN("webserver-api-calibrate-status");
   Log.notice(F("WEB : webServer callback for /api/calibrate/status." CR));
+  JobStatus job;
+
+  if (myJobs.getStatus(_sensorCalibrationJob, job) && job.result.length()) {
+    request->send(200, "application/json", job.result);
+    PERF_END("webserver-api-calibrate-status");
+    return;
+  }
+
+  bool active = myJobs.isActive(_sensorCalibrationJob);
   AsyncJsonResponse *response =
       new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
   JsonObject obj = response->getRoot().as<JsonObject>();
-  obj[PARAM_STATUS] = static_cast<bool>(_sensorCalibrationTask);
+  obj[PARAM_STATUS] = active;
   obj[PARAM_SUCCESS] = false;
-  obj[PARAM_MESSAGE] = "Calibration running";
+  obj[PARAM_MESSAGE] =
+      active ? "Calibration running" : "No calibration has been started";
+
+  if (active && _sensorCalibrationStep < 0) {
+    // Offsets are updated by the loop while the calibration is running, the
+    // values are taken from the cache so the sensor is not accessed here.
+    const RawGyroData &cal = myGyro.getCalibrationOffset();
+    obj[PARAM_PROGRESS] = myGyro.getCalibrationProgress();
+    JsonObject offset = obj.createNestedObject(PARAM_GYRO_CALIBRATION);
+    offset["ax"] = cal.ax;
+    offset["ay"] = cal.ay;
+    offset["az"] = cal.az;
+    offset["gx"] = cal.gx;
+    offset["gy"] = cal.gy;
+    offset["gz"] = cal.gz;
+  } else if (active) {
+    obj[PARAM_PROGRESS] = myGyro.getPositionProgress();
+  }
 
-  if (!_sensorCalibrationTask) {
-    if (myGyro.isConnected()) {
-      obj[PARAM_SUCCESS] = true;
-      obj[PARAM_MESSAGE] = "Calibration completed";
-    } else {
-      obj[PARAM_SUCCESS] = false;
-      obj[PARAM_MESSAGE] = "Calibration failed, no gyro connected";
+  response->setLength();
+  request->send(response);
+  PERF_END("webserver-api-calibrate-status");
+}
+
+// Wraps a handler so latency and heap usage is recorded for the route. Routes
+// that create a large json document pass its size and are refused with 503
+// when the heap is low.
+ArRequestHandlerFunction GravmonWebServer::withMetrics(
+    const char *route, const char *method, ArRequestHandlerFunction handler,
+    size_t size) {
+  RouteMetrics *m = myMetrics.add(route, method);
+
+  return [m, handler, size](AsyncWebServerRequest *request) {
+    if (!myAdmission.admit(request, size)) {
+      myMetrics.reject(m);
+      return;
     }
+
+    RequestSample sample = myMetrics.begin();
+    handler(request);
+    myMetrics.end(m, sample);
+  };
+}
+
+void GravmonWebServer::webHandleMetrics(AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  Log.notice(F("WEB : webServer callback for /api/metrics." CR));
+  AsyncResponseStream *response =
+      request->beginResponseStream("text/plain; version=0.0.4");
+  myMetrics.writePrometheus(*response);
+  ALLOC_METRICS(*response);
+  request->send(response);
+}
+
+// Static files are served with the content hash as etag so the browser can
+// revalidate them without downloading the file again. Files with the hash in
+// the name never change and can be cached without revalidation.
+void GravmonWebServer::webHandleAsset(AsyncWebServerRequest *request) {
+  String path = request->url().substring(strlen(ASSET_PREFIX));
+  const StaticAsset *asset = findStaticAsset(path.c_str());
+
+  if (!asset) {
+    request->send(404);
+    return;
+  }
+
+  AsyncWebServerResponse *response;
+
+  if (request->hasHeader("If-None-Match") &&
+      request->header("If-None-Match") == asset->etag) {
+    response = request->beginResponse(304);
+  } else {
+    response = request->beginResponse_P(200, asset->type, asset->data,
+                                        asset->length);
+    response->addHeader("Content-Encoding", "gzip");
+  }
+
+  response->addHeader("ETag", asset->etag);
+  response->addHeader("Cache-Control",
+                      asset->immutable ? "public, max-age=31536000, immutable"
+                                       : "no-cache");
+  request->send(response);
+}
+
+void GravmonWebServer::webHandleJobStatus(AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  PERF_BEGIN("webserver-api-job");
+  Log.notice(F("WEB : webServer callback for /api/job." CR));
+
+  // The id is the last part of the url, /api/job/<id>
+  String url = request->url();
+  int id = url.substring(url.lastIndexOf('/') + 1).toInt();
+  if (request->method() == HTTP_DELETE) myJobs.cancel(id);
+
+  JobStatus job;
+  bool found = myJobs.getStatus(id, job);
+  AsyncJsonResponse *response = new AsyncJsonResponse(
+      false, JSON_BUFFER_SIZE_S + job.result.length());
+  JsonObject obj = response->getRoot().as<JsonObject>();
+
+  if (found) {
+    obj[PARAM_JOB_ID] = job.id;
+    obj[PARAM_JOB_NAME] = job.name;
+    obj[PARAM_JOB_STATE] = JobScheduler::getStateName(job.state);
+    obj[PARAM_STATUS] =
+        job.state == JobState::queued || job.state == JobState::running;
+    obj[PARAM_SUCCESS] = job.success;
+    obj[PARAM_PROGRESS] = job.progress;
+    obj[PARAM_JOB_DURATION] = job.duration;
+
+    if (job.result.length()) obj[PARAM_JOB_RESULT] = serialized(job.result);
+  } else {
+    response->setCode(404);
+    obj[PARAM_SUCCESS] = false;
+    obj[PARAM_MESSAGE] = "Job not found";
   }
 
   response->setLength();
   request->send(response);
-  PERF_END("webserver-api-calibrate-status");
+  PERF_END("webserver-api-job");
 }
 
 void GravmonWebServer::webHandleFactoryDefaults(
@@ -149,6 +364,8 @@ void GravmonWebServer::webHandleFactoryDefaults(
   LittleFS.remove(TPL_FNAME_POST2);
   LittleFS.remove(TPL_FNAME_INFLUXDB);
   LittleFS.remove(TPL_FNAME_MQTT);
+  LittleFS.remove(CALIBRATION_FILENAME);
+  LittleFS.remove(GRAVITY_TABLE_FILENAME);
   LittleFS.end();
 
   Log.notice(F("WEB : Deleted files in filesystem, rebooting." CR));
@@ -165,6 +382,100 @@ void GravmonWebServer::webHandleFactoryDefaults(
   _rebootTask = true;
 }
 
+void GravmonWebServer::webHandleCalibrationExport(
+    AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  PERF_BEGIN("webserver-api-formula-data-export");
+  Log.notice(F("WEB : webServer callback for /api/formula/data(read)." CR));
+  AsyncResponseStream *response = request->beginResponseStream("text/csv");
+  myCalibrationStore.exportCsv(*response);
+  request->send(response);
+  PERF_END("webserver-api-formula-data-export");
+}
+
+void GravmonWebServer::webHandleCalibrationImportData(
+    AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+    size_t total) {
+  // The body arrives before the request handler, so the token is checked for
+  // every chunk to avoid flash writes from requests that will be rejected.
+  // Only the request that started the import can add to it, an import that
+  // is not completed is discarded when the client disconnects.
+  if (!hasAuthToken(request)) return;
+
+  if (index == 0 && !_importRequest) {
+    _importRequest = request;
+    myCalibrationStore.beginImport();
+    myAdmission.onDisconnect(request, [this, request]() {
+      if (_importRequest != request) return;
+
+      myCalibrationStore.endImport(false);
+      _importRequest = nullptr;
+    });
+  }
+
+  if (_importRequest == request) myCalibrationStore.importCsv(data, len);
+}
+
+void GravmonWebServer::webHandleCalibrationImport(
+    AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  PERF_BEGIN("webserver-api-formula-data-import");
+  Log.notice(F("WEB : webServer callback for /api/formula/data(write)." CR));
+  int cnt = -1;
+
+  if (_importRequest == request) {
+    cnt = myCalibrationStore.endImport(true);
+    _importRequest = nullptr;
+  }
+
+  AsyncJsonResponse *response =
+      new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
+  JsonObject obj = response->getRoot().as<JsonObject>();
+  obj[PARAM_SUCCESS] = cnt > 0 ? true : false;
+  obj[PARAM_MESSAGE] = cnt > 0    ? "Calibration points imported."
+                       : cnt == 0 ? "No valid calibration points found."
+                                  : "Failed to import calibration points.";
+  obj[PARAM_CALIBRATION_POINTS] = cnt > 0 ? cnt : 0;
+  response->setLength();
+  request->send(response);
+  PERF_END("webserver-api-formula-data-import");
+}
+
+void GravmonWebServer::webHandleCalibrationClear(
+    AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
+  }
+
+  Log.notice(F("WEB : webServer callback for /api/formula/data(delete)." CR));
+  bool b = myCalibrationStore.clear();
+
+  AsyncJsonResponse *response =
+      new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
+  JsonObject obj = response->getRoot().as<JsonObject>();
+  obj[PARAM_SUCCESS] = b;
+  obj[PARAM_MESSAGE] = b ? "Calibration points removed."
+                         : "Failed to remove calibration points.";
+  response->setLength();
+  request->send(response);
+}
+
+// Same check as isAuthenticated but without sending a response, used where
+// the request handler will respond later.
+bool GravmonWebServer::hasAuthToken(AsyncWebServerRequest *request) {
+  if (!request->hasHeader("Authorization")) return false;
+
+  String token("Bearer ");
+  token += myConfig.getID();
+  return request->getHeader("Authorization")->value() == token;
+}
+
 void GravmonWebServer::webHandleStatus(AsyncWebServerRequest *request) {
   PERF_BEGIN("webserver-api-status");
   Log.notice(F("WEB : webServer callback for /api/status(get)." CR));
@@ -314,27 +625,80 @@ void GravmonWebServer::webHandleFormulaCreate(AsyncWebServerRequest *request) {
 
   PERF_BEGIN("webserver-api-formula-create");
   Log.notice(F("WEB : webServer callback for /api/formula." CR));
+  AsyncJsonResponse *response =
+      new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
+  JsonObject obj = response->getRoot().as<JsonObject>();
 
-  int e, createErr;
-  char buf[100];
-  RawFormulaData fd = myConfig.getFormulaData();
+  if (myJobs.isActive(_formulaJob)) {
+    obj[PARAM_SUCCESS] = true;
+    obj[PARAM_MESSAGE] = "Formula creation is already running";
+  } else {
+    _formulaJob = myJobs.submit(
+        "formula", [this](Job &job) { return runFormulaCreation(job); });
+    obj[PARAM_SUCCESS] = _formulaJob != JOB_INVALID_ID;
+    obj[PARAM_MESSAGE] = _formulaJob != JOB_INVALID_ID
+                             ? "Scheduled formula creation"
+                             : "Unable to schedule formula creation";
+  }
 
-  e = createFormula(fd, &buf[0], sizeof(buf), 2);
+  obj[PARAM_JOB_ID] = _formulaJob;
+  response->setLength();
+  request->send(response);
+  PERF_END("webserver-api-formula-create");
+}
 
-  if (e) {
-    // If we fail with order=2 try with 3
-    Log.warning(F("WEB : Failed to find formula with order 3." CR), e);
-    e = createFormula(fd, &buf[0], sizeof(buf), 3);
+void GravmonWebServer::webHandleFormulaStatus(AsyncWebServerRequest *request) {
+  if (!isAuthenticated(request)) {
+    return;
   }
 
-  if (e) {
-    // If we fail with order=3 try with 4
-    Log.warning(F("WEB : Failed to find formula with order 4." CR), e);
-    e = createFormula(fd, &buf[0], sizeof(buf), 4);
+  Log.notice(F("WEB : webServer callback for /api/formula/status." CR));
+  JobStatus job;
+
+  if (myJobs.getStatus(_formulaJob, job) && job.result.length()) {
+    request->send(200, "application/json", job.result);
+    return;
+  }
+
+  bool active = myJobs.isActive(_formulaJob);
+  AsyncJsonResponse *response =
+      new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
+  JsonObject obj = response->getRoot().as<JsonObject>();
+  obj[PARAM_STATUS] = active;
+  obj[PARAM_SUCCESS] = false;
+  obj[PARAM_MESSAGE] =
+      active ? "Formula creation running" : "No formula creation running";
+  response->setLength();
+  request->send(response);
+}
+
+// The fit can use up to CALIBRATION_MAX_POINTS points and solves each order
+// once per point, so it runs from the loop and not in the web callback.
+bool GravmonWebServer::runFormulaCreation(Job &job) {
+  if (job.cancelled) return true;
+
+  int e, createErr;
+  char buf[configStringCapacity(CFG_STR_GRAVITY_FORMULA) + 1];
+
+  // Selects the order that passes validation with the lowest cross validated
+  // error. Imported calibration points are used instead of the configuration
+  // if there are any.
+  if (myCalibrationStore.size()) {
+    Log.notice(F("WEB : Using %d points from calibration store." CR),
+               myCalibrationStore.size());
+    e = createFormula(
+        [](const FormulaPointCallback &callback) {
+          myCalibrationStore.forEach([&callback](const CalibrationPoint &p) {
+            callback(p.angle, p.gravity, p.tempC);
+          });
+        },
+        &buf[0], sizeof(buf), FORMULA_MIN_ORDER, FORMULA_MAX_ORDER);
+  } else {
+    RawFormulaData fd = myConfig.getFormulaData();
+    e = createFormula(fd, &buf[0], sizeof(buf));
   }
 
   if (e) {
-    // If we fail with order=4 then we mark it as failed
     Log.error(
         F("WEB : Unable to find formula based on provided values err=%d." CR),
         e);
@@ -344,14 +708,17 @@ void GravmonWebServer::webHandleFormulaCreate(AsyncWebServerRequest *request) {
     Log.info(F("WEB : Found valid formula: '%s'" CR), &buf[0]);
     myConfig.setGravityFormula(buf);
     myConfig.saveFile();
+    myGravityTable.update();
     createErr = 0;
   }
 
-  AsyncJsonResponse *response =
-      new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
-  JsonObject obj = response->getRoot().as<JsonObject>();
+  DynamicJsonDocument doc(JSON_BUFFER_SIZE_S);
+  JsonObject obj = doc.to<JsonObject>();
 
-  obj[PARAM_SUCCESS] = createErr ? false : true;
+  job.success = createErr ? false : true;
+  job.progress = 100;
+  obj[PARAM_STATUS] = false;
+  obj[PARAM_SUCCESS] = job.success;
   obj[PARAM_GRAVITY_FORMULA] = "";
   obj[PARAM_MESSAGE] = "";
 
@@ -374,9 +741,8 @@ void GravmonWebServer::webHandleFormulaCreate(AsyncWebServerRequest *request) {
       break;
   }
 
-  response->setLength();
-  request->send(response);
-  PERF_END("webserver-api-formula-create");
+  serializeJson(obj, job.result);
+  return true;
 }
 
 void GravmonWebServer::webHandleConfigFormatWrite(
@@ -428,16 +794,29 @@ void GravmonWebServer::webHandleTestPush(AsyncWebServerRequest *request,
   PERF_BEGIN("webserver-api-test-push");
   Log.notice(F("WEB : webServer callback for /api/test/push." CR));
   JsonObject obj = json.as<JsonObject>();
-  _pushTestTarget = obj[PARAM_PUSH_FORMAT].as<String>();
-  _pushTestTask = true;
-  _pushTestEnabled = false;
-  _pushTestLastSuccess = false;
-  _pushTestLastCode = 0;
+  String target = obj[PARAM_PUSH_FORMAT].as<String>();
   AsyncJsonResponse *response =
       new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
   obj = response->getRoot().as<JsonObject>();
-  obj[PARAM_SUCCESS] = true;
-  obj[PARAM_MESSAGE] = "Scheduled test for " + _pushTestTarget;
+
+  if (myJobs.isActive(_pushTestJob)) {
+    obj[PARAM_SUCCESS] = true;
+    obj[PARAM_MESSAGE] =
+        "Push test for " + _pushTestTarget + " is already running";
+  } else {
+    _pushTestTarget = target;
+    auto result = std::make_shared<DynamicJsonDocument>(JSON_BUFFER_SIZE_L);
+    _pushTestJob = myJobs.submit(
+        "push", [this, target, result, index = 0](Job &job) mutable {
+          return runPushTest(job, target, index, *result);
+        });
+    obj[PARAM_SUCCESS] = _pushTestJob != JOB_INVALID_ID;
+    obj[PARAM_MESSAGE] = _pushTestJob != JOB_INVALID_ID
+                             ? "Scheduled test for " + target
+                             : "Unable to schedule test for " + target;
+  }
+
+  obj[PARAM_JOB_ID] = _pushTestJob;
   response->setLength();
   request->send(response);
   PERF_END("webserver-api-test-push");
@@ -446,23 +825,24 @@ void GravmonWebServer::webHandleTestPush(AsyncWebServerRequest *request,
 void GravmonWebServer::webHandleTestPushStatus(AsyncWebServerRequest *request) {
   PERF_BEGIN("webserver-api-test-push-status");
   Log.notice(F("WEB : webServer callback for /api/test/push/status." CR));
+  JobStatus job;
+
+  if (myJobs.getStatus(_pushTestJob, job) && job.result.length()) {
+    request->send(200, "application/json", job.result);
+    PERF_END("webserver-api-test-push-status");
+    return;
+  }
+
+  bool active = myJobs.isActive(_pushTestJob);
   AsyncJsonResponse *response =
       new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
   JsonObject obj = response->getRoot().as<JsonObject>();
-  String s;
-
-  if (_pushTestTask)
-    s = "Running push tests for " + _pushTestTarget;
-  else if (!_pushTestTask && _pushTestLastSuccess == 0)
-    s = "No push test has been started";
-  else
-    s = "Push test for " + _pushTestTarget + " is complete";
-
-  obj[PARAM_STATUS] = static_cast<bool>(_pushTestTask);
-  obj[PARAM_SUCCESS] = _pushTestLastSuccess;
-  obj[PARAM_MESSAGE] = s;
-  obj[PARAM_PUSH_ENABLED] = _pushTestEnabled;
-  obj[PARAM_PUSH_RETURN_CODE] = _pushTestLastCode;
+  obj[PARAM_STATUS] = active;
+  obj[PARAM_SUCCESS] = false;
+  obj[PARAM_MESSAGE] = active ? "Running push tests for " + _pushTestTarget
+                              : String("No push test has been started");
+  obj[PARAM_PUSH_ENABLED] = false;
+  obj[PARAM_PUSH_RETURN_CODE] = 0;
   response->setLength();
   request->send(response);
   PERF_END("webserver-api-test-push-status");
@@ -499,13 +879,23 @@ void GravmonWebServer::webHandleHardwareScan(AsyncWebServerRequest *request) {
   }
 
   Log.notice(F("WEB : webServer callback for /api/hardware." CR));
-  _hardwareScanTask = true;
-  _hardwareScanData = "";
   AsyncJsonResponse *response =
       new AsyncJsonResponse(false, JSON_BUFFER_SIZE_S);
   JsonObject obj = response->getRoot().as<JsonObject>();
-  obj[PARAM_SUCCESS] = true;
-  obj[PARAM_MESSAGE] = "Scheduled hardware scanning";
+
+  if (myJobs.isActive(_hardwareScanJob)) {
+    obj[PARAM_SUCCESS] = true;
+    obj[PARAM_MESSAGE] = "Hardware scanning is already running";
+  } else {
+    _hardwareScanJob = myJobs.submit(
+        "hardware", [this](Job &job) { return runHardwareScan(job); });
+    obj[PARAM_SUCCESS] = _hardwareScanJob != JOB_INVALID_ID;
+    obj[PARAM_MESSAGE] = _hardwareScanJob != JOB_INVALID_ID
+                             ? "Scheduled hardware scanning"
+                             : "Unable to schedule hardware scanning";
+  }
+
+  obj[PARAM_JOB_ID] = _hardwareScanJob;
   response->setLength();
   request->send(response);
 }
@@ -517,19 +907,21 @@ void GravmonWebServer::webHandleHardwareScanStatus(
   }
 
   Log.notice(F("WEB : webServer callback for /api/hardware/status." CR));
+  JobStatus job;
 
-  if (_hardwareScanTask || !_hardwareScanData.length()) {
+  if (myJobs.getStatus(_hardwareScanJob, job) && job.result.length()) {
+    request->send(200, "application/json", job.result);
+  } else {
+    bool active = myJobs.isActive(_hardwareScanJob);
     AsyncJsonResponse *response =
         new AsyncJsonResponse(false, JSON_BUFFER_SIZE_L);
     JsonObject obj = response->getRoot().as<JsonObject>();
-    obj[PARAM_STATUS] = static_cast<bool>(_hardwareScanTask);
+    obj[PARAM_STATUS] = active;
     obj[PARAM_SUCCESS] = false;
     obj[PARAM_MESSAGE] =
-        _hardwareScanTask ? "Hardware scanning running" : "No scanning running";
+        active ? "Hardware scanning running" : "No scanning running";
     response->setLength();
     request->send(response);
-  } else {
-    request->send(200, "application/json", _hardwareScanData);
   }
 }
 
@@ -590,57 +982,116 @@ bool GravmonWebServer::setupWebServer() {
   // Static content
   Log.notice(F("WEB : Setting up handlers for gravmon web server." CR));
 
-  AsyncCallbackJsonWebHandler *handler;
+  // Requests for the ui files are rewritten to the asset handler, rewrites are
+  // applied before the handlers in the base class are matched.
+  _server->rewrite("/", (String(ASSET_PREFIX) + "/index.html").c_str());
+  for (size_t i = 0; i < staticAssetCount; i++) {
+    _server->rewrite(staticAssets[i].path,
+                     (String(ASSET_PREFIX) + staticAssets[i].path).c_str());
+  }
+  _server->on(ASSET_PREFIX, HTTP_GET,
+              withMetrics(ASSET_PREFIX, "GET",
+                          std::bind(&GravmonWebServer::webHandleAsset, this,
+                                    std::placeholders::_1)));
+
+  AdmissionJsonHandler *handler;
   _server->on("/api/format", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleConfigFormatRead, this,
-                        std::placeholders::_1));
-  handler = new AsyncCallbackJsonWebHandler(
-      "/api/format",
+              withMetrics(
+                  "/api/format", "GET",
+                  std::bind(&GravmonWebServer::webHandleConfigFormatRead, this,
+                            std::placeholders::_1),
+                  JSON_BUFFER_SIZE_XL));
+  handler = new AdmissionJsonHandler(
+      "/api/format", HTTP_POST,
       std::bind(&GravmonWebServer::webHandleConfigFormatWrite, this,
                 std::placeholders::_1, std::placeholders::_2),
-      JSON_BUFFER_SIZE_L);
+      JSON_BUFFER_SIZE_L, JSON_BUFFER_SIZE_S);
   _server->addHandler(handler);
-  handler = new AsyncCallbackJsonWebHandler(
-      "/api/sleepmode",
+  handler = new AdmissionJsonHandler(
+      "/api/sleepmode", HTTP_POST,
       std::bind(&GravmonWebServer::webHandleSleepmode, this,
                 std::placeholders::_1, std::placeholders::_2),
       JSON_BUFFER_SIZE_S);
   _server->addHandler(handler);
-  handler = new AsyncCallbackJsonWebHandler(
-      "/api/config",
+  handler = new AdmissionJsonHandler(
+      "/api/config", HTTP_POST | HTTP_PUT | HTTP_PATCH,
       std::bind(&GravmonWebServer::webHandleConfigWrite, this,
                 std::placeholders::_1, std::placeholders::_2),
-      JSON_BUFFER_SIZE_L);
+      JSON_BUFFER_SIZE_L, JSON_BUFFER_SIZE_S);
   _server->addHandler(handler);
   _server->on("/api/config", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleConfigRead, this,
-                        std::placeholders::_1));
+              withMetrics("/api/config", "GET",
+                          std::bind(&GravmonWebServer::webHandleConfigRead,
+                                    this, std::placeholders::_1),
+                          JSON_BUFFER_SIZE_L));
+  _server->on("/api/formula/data", HTTP_GET,
+              withMetrics(
+                  "/api/formula/data", "GET",
+                  std::bind(&GravmonWebServer::webHandleCalibrationExport, this,
+                            std::placeholders::_1)));
+  _server->on(
+      "/api/formula/data", HTTP_POST,
+      withMetrics("/api/formula/data", "POST",
+                  std::bind(&GravmonWebServer::webHandleCalibrationImport,
+                            this, std::placeholders::_1)),
+      NULL,
+      std::bind(&GravmonWebServer::webHandleCalibrationImportData, this,
+                std::placeholders::_1, std::placeholders::_2,
+                std::placeholders::_3, std::placeholders::_4,
+                std::placeholders::_5));
+  _server->on("/api/formula/data", HTTP_DELETE,
+              withMetrics(
+                  "/api/formula/data", "DELETE",
+                  std::bind(&GravmonWebServer::webHandleCalibrationClear, this,
+                            std::placeholders::_1)));
+  _server->on("/api/formula/status", HTTP_GET,
+              withMetrics("/api/formula/status", "GET",
+                          std::bind(&GravmonWebServer::webHandleFormulaStatus,
+                                    this, std::placeholders::_1)));
   _server->on("/api/formula", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleFormulaCreate, this,
-                        std::placeholders::_1));
+              withMetrics("/api/formula", "GET",
+                          std::bind(&GravmonWebServer::webHandleFormulaCreate,
+                                    this, std::placeholders::_1)));
   _server->on("/api/calibrate/status", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleCalibrateStatus, this,
-                        std::placeholders::_1));
+              withMetrics("/api/calibrate/status", "GET",
+                          std::bind(&GravmonWebServer::webHandleCalibrateStatus,
+                                    this, std::placeholders::_1)));
   _server->on("/api/calibrate", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleCalibrate, this,
-                        std::placeholders::_1));
+              withMetrics("/api/calibrate", "GET",
+                          std::bind(&GravmonWebServer::webHandleCalibrate, this,
+                                    std::placeholders::_1)));
   _server->on("/api/hardware/status", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleHardwareScanStatus, this,
-                        std::placeholders::_1));
+              withMetrics(
+                  "/api/hardware/status", "GET",
+                  std::bind(&GravmonWebServer::webHandleHardwareScanStatus,
+                            this, std::placeholders::_1),
+                  JSON_BUFFER_SIZE_L));
   _server->on("/api/hardware", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleHardwareScan, this,
+              withMetrics("/api/hardware", "GET",
+                          std::bind(&GravmonWebServer::webHandleHardwareScan,
+                                    this, std::placeholders::_1)));
+  _server->on("/api/metrics", HTTP_GET,
+              std::bind(&GravmonWebServer::webHandleMetrics, this,
                         std::placeholders::_1));
+  _server->on("/api/job", HTTP_GET | HTTP_DELETE,
+              withMetrics("/api/job", "GET|DELETE",
+                          std::bind(&GravmonWebServer::webHandleJobStatus, this,
+                                    std::placeholders::_1)));
   _server->on("/api/factory", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleFactoryDefaults, this,
-                        std::placeholders::_1));
+              withMetrics("/api/factory", "GET",
+                          std::bind(&GravmonWebServer::webHandleFactoryDefaults,
+                                    this, std::placeholders::_1)));
   _server->on("/api/status", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleStatus, this,
-                        std::placeholders::_1));
+              withMetrics("/api/status", "GET",
+                          std::bind(&GravmonWebServer::webHandleStatus, this,
+                                    std::placeholders::_1),
+                          JSON_BUFFER_SIZE_L));
   _server->on("/api/push/status", HTTP_GET,
-              std::bind(&GravmonWebServer::webHandleTestPushStatus, this,
-                        std::placeholders::_1));
-  handler = new AsyncCallbackJsonWebHandler(
-      "/api/push",
+              withMetrics("/api/push/status", "GET",
+                          std::bind(&GravmonWebServer::webHandleTestPushStatus,
+                                    this, std::placeholders::_1)));
+  handler = new AdmissionJsonHandler(
+      "/api/push", HTTP_POST,
       std::bind(&GravmonWebServer::webHandleTestPush, this,
                 std::placeholders::_1, std::placeholders::_2),
       JSON_BUFFER_SIZE_S);
@@ -656,201 +1107,226 @@ void GravmonWebServer::loop() {
 #endif
   BaseWebServer::loop();
 
-  if (_sensorCalibrationTask) {
-    if (myGyro.isConnected()) {
-      myGyro.calibrateSensor();
-    } else {
-      Log.error(F("WEB : No gyro connected, skipping calibration" CR));
-    }
+  myJobs.loop();
+}
+
+struct PushTestTarget {
+  const char *format;
+  GravmonPush::Templates tpl;
+};
+
+const PushTestTarget pushTestTargets[] = {
+    {PARAM_FORMAT_POST, GravmonPush::TEMPLATE_HTTP1},
+    {PARAM_FORMAT_POST2, GravmonPush::TEMPLATE_HTTP2},
+    {PARAM_FORMAT_GET, GravmonPush::TEMPLATE_HTTP3},
+    {PARAM_FORMAT_INFLUXDB, GravmonPush::TEMPLATE_INFLUX},
+    {PARAM_FORMAT_MQTT, GravmonPush::TEMPLATE_MQTT},
+};
 
-    _sensorCalibrationTask = false;
+constexpr auto PUSH_TEST_TARGETS =
+    sizeof(pushTestTargets) / sizeof(pushTestTargets[0]);
+
+// One target is sent per step so the loop can run between the targets when
+// all of them are tested.
+bool GravmonWebServer::runPushTest(Job &job, const String &target, int &index,
+                                   JsonDocument &result) {
+  if (job.cancelled) return true;
+
+  JsonObject obj = result.as<JsonObject>();
+
+  if (obj.isNull()) {
+    Log.notice(F("WEB : Running scheduled push test for %s" CR),
+               target.c_str());
+    obj = result.to<JsonObject>();
+    obj.createNestedArray(PARAM_PUSH_TARGETS);
+    obj[PARAM_PUSH_ENABLED] = false;
+    obj[PARAM_PUSH_RETURN_CODE] = 0;
+    job.success = true;
   }
 
-  if (_pushTestTask) {
+  const PushTestTarget &t = pushTestTargets[index];
+
+  if (!target.compareTo(PARAM_PUSH_ALL) || !target.compareTo(t.format)) {
     float angle = myGyro.getAngle();
     float tempC = myTempSensor.getTempC();
     float gravitySG = calculateGravity(angle, tempC);
     float corrGravitySG = gravityTemperatureCorrectionC(
         gravitySG, tempC, myConfig.getDefaultCalibrationTemp());
 
-    Log.notice(F("WEB : Running scheduled push test for %s" CR),
-               _pushTestTarget.c_str());
-
+    PushTiming timing;
     TemplatingEngine engine;
     GravmonPush push(&myConfig);
     push.setupTemplateEngine(engine, angle, gravitySG, corrGravitySG, tempC,
                              1.0, myBatteryVoltage.getVoltage());
-
-    if (!_pushTestTarget.compareTo(PARAM_FORMAT_POST) &&
-        myConfig.hasTargetHttpPost()) {
-      String tpl = push.getTemplate(GravmonPush::TEMPLATE_HTTP1);
-      String doc = engine.create(tpl.c_str());
-      push.sendHttpPost(doc);
-      _pushTestEnabled = true;
-    } else if (!_pushTestTarget.compareTo(PARAM_FORMAT_POST2) &&
-               myConfig.hasTargetHttpPost2()) {
-      String tpl = push.getTemplate(GravmonPush::TEMPLATE_HTTP2);
-      String doc = engine.create(tpl.c_str());
-      push.sendHttpPost2(doc);
-      _pushTestEnabled = true;
-    } else if (!_pushTestTarget.compareTo(PARAM_FORMAT_GET) &&
-               myConfig.hasTargetHttpGet()) {
-      String tpl = push.getTemplate(GravmonPush::TEMPLATE_HTTP3);
-      String doc = engine.create(tpl.c_str());
-      push.sendHttpGet(doc);
-      _pushTestEnabled = true;
-    } else if (!_pushTestTarget.compareTo(PARAM_FORMAT_INFLUXDB) &&
-               myConfig.hasTargetInfluxDb2()) {
-      String tpl = push.getTemplate(GravmonPush::TEMPLATE_INFLUX);
-      String doc = engine.create(tpl.c_str());
-      push.sendInfluxDb2(doc);
-      _pushTestEnabled = true;
-    } else if (!_pushTestTarget.compareTo(PARAM_FORMAT_MQTT) &&
-               myConfig.hasTargetMqtt()) {
-      String tpl = push.getTemplate(GravmonPush::TEMPLATE_MQTT);
-      String doc = engine.create(tpl.c_str());
-      push.sendMqtt(doc);
-      _pushTestEnabled = true;
-    }
-
+    push.sendTarget(t.tpl, engine, timing);
     engine.freeMemory();
     push.clearTemplate();
-    _pushTestLastSuccess = push.getLastSuccess();
-    _pushTestLastCode = push.getLastCode();
-    if (_pushTestEnabled)
+
+    if (timing.enabled) {
+      JsonObject r = obj[PARAM_PUSH_TARGETS].createNestedObject();
+      r[PARAM_PUSH_FORMAT] = t.format;
+      r[PARAM_SUCCESS] = timing.success;
+      r[PARAM_PUSH_RETURN_CODE] = timing.code;
+      r[PARAM_PUSH_TIME_RENDER] = timing.render;
+      r[PARAM_PUSH_TIME_DNS] = timing.dns;
+      r[PARAM_PUSH_TIME_CONNECT] = timing.connect;
+      r[PARAM_PUSH_TIME_TLS] = timing.tls;
+      r[PARAM_PUSH_TIME_REQUEST] = timing.request;
+      r[PARAM_PUSH_TIME_RESPONSE] = timing.response;
+      r[PARAM_PUSH_TIME_SEND] = timing.send;
+
+      obj[PARAM_PUSH_ENABLED] = true;
+      obj[PARAM_PUSH_RETURN_CODE] = timing.code;
+      job.success = job.success && timing.success;
+
       Log.notice(
           F("WEB : Scheduled push test %s completed, success=%d, code=%d" CR),
-          _pushTestTarget.c_str(), _pushTestLastSuccess, _pushTestLastCode);
-    else
+          t.format, timing.success, timing.code);
+    } else {
       Log.notice(F("WEB : Scheduled push test %s failed, not enabled" CR),
-                 _pushTestTarget.c_str());
-    _pushTestTask = false;
+                 t.format);
+    }
   }
 
-  if (_hardwareScanTask) {
-    DynamicJsonDocument doc(JSON_BUFFER_SIZE_L);
-    JsonObject obj = doc.createNestedObject();
-    obj[PARAM_STATUS] = false;
-    obj[PARAM_SUCCESS] = true;
-    obj[PARAM_MESSAGE] = "";
-    Log.notice(F("WEB : Scanning hardware." CR));
-
-    // Scan the i2c bus for devices
-    // Wire.begin(PIN_SDA, PIN_SCL); // Should already have been done in
-    // gyro.cpp
-    JsonArray i2c = obj.createNestedArray(PARAM_I2C);
-
-    for (int i = 1; i < 127; i++) {
-      // The i2c_scanner uses the return value of
-      // the Write.endTransmisstion to see if
-      // a device did acknowledge to the address.
-      Wire.beginTransmission(i);
-      int err = Wire.endTransmission();
-
-      if (err == 0) {
-        JsonObject sensor = i2c.createNestedObject();
-        sensor[PARAM_ADRESS] = "0x" + String(i, 16);
-      }
-    }
+  job.progress = (index + 1) * 100 / PUSH_TEST_TARGETS;
 
-    // Scan onewire
-    JsonArray onew = obj.createNestedArray(PARAM_ONEWIRE);
-
-    for (int i = 0; i < mySensors.getDS18Count(); i++) {
-      DeviceAddress adr;
-      JsonObject sensor = onew.createNestedObject();
-      mySensors.getAddress(&adr[0], i);
-      sensor[PARAM_ADRESS] = String(adr[0], 16) + String(adr[1], 16) +
-                             String(adr[2], 16) + String(adr[3], 16) +
-                             String(adr[4], 16) + String(adr[5], 16) +
-                             String(adr[6], 16) + String(adr[7], 16);
-      switch (adr[0]) {
-        case DS18S20MODEL:
-          sensor[PARAM_FAMILY] = "DS18S20";
-          break;
-        case DS18B20MODEL:
-          sensor[PARAM_FAMILY] = "DS18B20";
-          break;
-        case DS1822MODEL:
-          sensor[PARAM_FAMILY] = "DS1822";
-          break;
-        case DS1825MODEL:
-          sensor[PARAM_FAMILY] = "DS1825";
-          break;
-        case DS28EA00MODEL:
-          sensor[PARAM_FAMILY] = "DS28EA00";
-          break;
-      }
-      sensor[PARAM_RESOLUTION] = mySensors.getResolution();
+  if (++index < static_cast<int>(PUSH_TEST_TARGETS)) return false;
+
+  if (!obj[PARAM_PUSH_ENABLED].as<bool>()) job.success = false;
+
+  obj[PARAM_STATUS] = false;
+  obj[PARAM_SUCCESS] = job.success;
+  obj[PARAM_MESSAGE] = "Push test for " + target + " is complete";
+  serializeJson(obj, job.result);
+  return true;
+}
+
+bool GravmonWebServer::runHardwareScan(Job &job) {
+  if (job.cancelled) return true;
+
+  DynamicJsonDocument doc(JSON_BUFFER_SIZE_L);
+  JsonObject obj = doc.createNestedObject();
+  obj[PARAM_STATUS] = false;
+  obj[PARAM_SUCCESS] = true;
+  obj[PARAM_MESSAGE] = "";
+  Log.notice(F("WEB : Scanning hardware." CR));
+
+  // Scan the i2c bus for devices
+  // Wire.begin(PIN_SDA, PIN_SCL); // Should already have been done in
+  // gyro.cpp
+  JsonArray i2c = obj.createNestedArray(PARAM_I2C);
+
+  for (int i = 1; i < 127; i++) {
+    // The i2c_scanner uses the return value of
+    // the Write.endTransmisstion to see if
+    // a device did acknowledge to the address.
+    Wire.beginTransmission(i);
+    int err = Wire.endTransmission();
+
+    if (err == 0) {
+      JsonObject sensor = i2c.createNestedObject();
+      sensor[PARAM_ADRESS] = "0x" + String(i, 16);
     }
+  }
 
-    // TODO: Test the gyro
-    JsonObject gyro = obj.createNestedObject(PARAM_GYRO);
-    switch (myGyro.getGyroID()) {
-      case 0x34:
-        gyro[PARAM_FAMILY] = "MPU6050";
+  // Scan onewire
+  JsonArray onew = obj.createNestedArray(PARAM_ONEWIRE);
+
+  for (int i = 0; i < mySensors.getDS18Count(); i++) {
+    DeviceAddress adr;
+    JsonObject sensor = onew.createNestedObject();
+    mySensors.getAddress(&adr[0], i);
+    sensor[PARAM_ADRESS] = String(adr[0], 16) + String(adr[1], 16) +
+                           String(adr[2], 16) + String(adr[3], 16) +
+                           String(adr[4], 16) + String(adr[5], 16) +
+                           String(adr[6], 16) + String(adr[7], 16);
+    switch (adr[0]) {
+      case DS18S20MODEL:
+        sensor[PARAM_FAMILY] = "DS18S20";
         break;
-      case 0x38:
-        gyro[PARAM_FAMILY] = "MPU6500";
+      case DS18B20MODEL:
+        sensor[PARAM_FAMILY] = "DS18B20";
         break;
-      default:
-        gyro[PARAM_FAMILY] = "0x" + String(myGyro.getGyroID(), 16);
+      case DS1822MODEL:
+        sensor[PARAM_FAMILY] = "DS1822";
+        break;
+      case DS1825MODEL:
+        sensor[PARAM_FAMILY] = "DS1825";
+        break;
+      case DS28EA00MODEL:
+        sensor[PARAM_FAMILY] = "DS28EA00";
         break;
     }
+    sensor[PARAM_RESOLUTION] = mySensors.getResolution();
+  }
 
-    // TODO: Test GPIO
+  // TODO: Test the gyro
+  JsonObject gyro = obj.createNestedObject(PARAM_GYRO);
+  switch (myGyro.getGyroID()) {
+    case 0x34:
+      gyro[PARAM_FAMILY] = "MPU6050";
+      break;
+    case 0x38:
+      gyro[PARAM_FAMILY] = "MPU6500";
+      break;
+    default:
+      gyro[PARAM_FAMILY] = "0x" + String(myGyro.getGyroID(), 16);
+      break;
+  }
+
+  // TODO: Test GPIO
 
-    JsonObject cpu = obj.createNestedObject(PARAM_CHIP);
+  JsonObject cpu = obj.createNestedObject(PARAM_CHIP);
 
 #if defined(ESP8266)
-    cpu[PARAM_FAMILY] = "ESP8266";
+  cpu[PARAM_FAMILY] = "ESP8266";
 #else
-    esp_chip_info_t chip_info;
-    esp_chip_info(&chip_info);
-
-    cpu[PARAM_REVISION] = chip_info.revision;
-    cpu[PARAM_CORES] = chip_info.cores;
-
-    JsonArray feature = cpu.createNestedArray(PARAM_FEATURES);
-
-    if (chip_info.features & CHIP_FEATURE_EMB_FLASH)
-      feature.add("embedded flash");
-    if (chip_info.features & CHIP_FEATURE_WIFI_BGN)
-      feature.add("Embedded Flash");
-    if (chip_info.features & CHIP_FEATURE_EMB_FLASH) feature.add("2.4Ghz WIFI");
-    if (chip_info.features & CHIP_FEATURE_BLE) feature.add("Bluetooth LE");
-    if (chip_info.features & CHIP_FEATURE_BT) feature.add("Bluetooth Classic");
-    if (chip_info.features & CHIP_FEATURE_IEEE802154)
-      feature.add("IEEE 802.15.4/LR-WPAN");
-    if (chip_info.features & CHIP_FEATURE_EMB_PSRAM)
-      feature.add("Embedded PSRAM");
-
-    switch (chip_info.model) {
-      case CHIP_ESP32:
-        cpu[PARAM_FAMILY] = "ESP32";
-        break;
-      case CHIP_ESP32S2:
-        cpu[PARAM_FAMILY] = "ESP32S2";
-        break;
-      case CHIP_ESP32S3:
-        cpu[PARAM_FAMILY] = "ESP32S3";
-        break;
-      case CHIP_ESP32C3:
-        cpu[PARAM_FAMILY] = "ESP32C3";
-        break;
-      case CHIP_ESP32H2:
-        cpu[PARAM_FAMILY] = "ESP32H2";
-        break;
-      default:
-        cpu[PARAM_FAMILY] = String(chip_info.model);
-        break;
-    }
+  esp_chip_info_t chip_info;
+  esp_chip_info(&chip_info);
+
+  cpu[PARAM_REVISION] = chip_info.revision;
+  cpu[PARAM_CORES] = chip_info.cores;
+
+  JsonArray feature = cpu.createNestedArray(PARAM_FEATURES);
+
+  if (chip_info.features & CHIP_FEATURE_EMB_FLASH)
+    feature.add("embedded flash");
+  if (chip_info.features & CHIP_FEATURE_WIFI_BGN)
+    feature.add("Embedded Flash");
+  if (chip_info.features & CHIP_FEATURE_EMB_FLASH) feature.add("2.4Ghz WIFI");
+  if (chip_info.features & CHIP_FEATURE_BLE) feature.add("Bluetooth LE");
+  if (chip_info.features & CHIP_FEATURE_BT) feature.add("Bluetooth Classic");
+  if (chip_info.features & CHIP_FEATURE_IEEE802154)
+    feature.add("IEEE 802.15.4/LR-WPAN");
+  if (chip_info.features & CHIP_FEATURE_EMB_PSRAM)
+    feature.add("Embedded PSRAM");
+
+  switch (chip_info.model) {
+    case CHIP_ESP32:
+      cpu[PARAM_FAMILY] = "ESP32";
+      break;
+    case CHIP_ESP32S2:
+      cpu[PARAM_FAMILY] = "ESP32S2";
+      break;
+    case CHIP_ESP32S3:
+      cpu[PARAM_FAMILY] = "ESP32S3";
+      break;
+    case CHIP_ESP32C3:
+      cpu[PARAM_FAMILY] = "ESP32C3";
+      break;
+    case CHIP_ESP32H2:
+      cpu[PARAM_FAMILY] = "ESP32H2";
+      break;
+    default:
+      cpu[PARAM_FAMILY] = String(chip_info.model);
+      break;
+  }
 #endif
 
-    serializeJson(obj, _hardwareScanData);
-    Log.notice(F("WEB : Scan complete %s." CR), _hardwareScanData.c_str());
-    _hardwareScanTask = false;
-  }
+  serializeJson(obj, job.result);
+  Log.notice(F("WEB : Scan complete %s." CR), job.result.c_str());
+  job.success = true;
+  return true;
 }
 
 // EOF
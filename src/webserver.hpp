@@ -25,18 +25,17 @@ SOFTWARE.
 #define SRC_WEBSERVER_HPP_
 
 #include <basewebserver.hpp>
+#include <job.hpp>
 
 class GravmonWebServer : public BaseWebServer {
  private:
-  volatile bool _sensorCalibrationTask = false;
-  volatile bool _pushTestTask = false;
-  volatile bool _hardwareScanTask = false;
-
-  String _hardwareScanData;
-
+  int _sensorCalibrationJob = JOB_INVALID_ID;
+  int _sensorCalibrationStep = -1;
+  int _pushTestJob = JOB_INVALID_ID;
   String _pushTestTarget;
-  int _pushTestLastCode;
-  bool _pushTestLastSuccess, _pushTestEnabled;
+  int _hardwareScanJob = JOB_INVALID_ID;
+  int _formulaJob = JOB_INVALID_ID;
+  AsyncWebServerRequest *_importRequest = nullptr;  // Owner of the import
 
   void webHandleStatus(AsyncWebServerRequest *request);
   void webHandleConfigRead(AsyncWebServerRequest *request);
@@ -46,6 +45,13 @@ class GravmonWebServer : public BaseWebServer {
                                   JsonVariant &json);
   void webHandleSleepmode(AsyncWebServerRequest *request, JsonVariant &json);
   void webHandleFormulaCreate(AsyncWebServerRequest *request);
+  void webHandleFormulaStatus(AsyncWebServerRequest *request);
+  void webHandleCalibrationExport(AsyncWebServerRequest *request);
+  void webHandleCalibrationImport(AsyncWebServerRequest *request);
+  void webHandleCalibrationImportData(AsyncWebServerRequest *request,
+                                      uint8_t *data, size_t len, size_t index,
+                                      size_t total);
+  void webHandleCalibrationClear(AsyncWebServerRequest *request);
   void webHandleTestPush(AsyncWebServerRequest *request, JsonVariant &json);
   void webHandleTestPushStatus(AsyncWebServerRequest *request);
   void webHandleCalibrate(AsyncWebServerRequest *request);
@@ -53,7 +59,21 @@ class GravmonWebServer : public BaseWebServer {
   void webHandleFactoryDefaults(AsyncWebServerRequest *request);
   void webHandleHardwareScan(AsyncWebServerRequest *request);
   void webHandleHardwareScanStatus(AsyncWebServerRequest *request);
+  void webHandleJobStatus(AsyncWebServerRequest *request);
+  void webHandleMetrics(AsyncWebServerRequest *request);
+  void webHandleAsset(AsyncWebServerRequest *request);
+
+  ArRequestHandlerFunction withMetrics(const char *route, const char *method,
+                                       ArRequestHandlerFunction handler,
+                                       size_t size = 0);
+
+  bool runCalibration(Job &job, int step);
+  bool runPushTest(Job &job, const String &target, int &index,
+                   JsonDocument &result);
+  bool runHardwareScan(Job &job);
+  bool runFormulaCreation(Job &job);
 
+  bool hasAuthToken(AsyncWebServerRequest *request);
   String readFile(String fname);
   bool writeFile(String fname, String data);
 
@@ -1,4 +1,4 @@
-import unittest, requests, json, time, urllib3
+import unittest, requests, json, time, urllib3, re
 
 ver  = "2.0.0"
 
@@ -18,6 +18,14 @@ def call_api_post( path, json ):
     url = "http://" + host + path
     return requests.post( url, json=json, headers=headers)
 
+def call_api_patch( path, json ):
+    url = "http://" + host + path
+    return requests.patch( url, json=json, headers=headers)
+
+def call_api_delete( path ):
+    url = "http://" + host + path
+    return requests.delete( url, headers=headers )
+
 def call_api_get( path ):
     url = "http://" + host + path
     return requests.get( url, headers=headers )
@@ -26,6 +34,14 @@ def call_api_auth( path, auth ):
     url = "http://" + host + path
     return requests.get( url, headers=auth )
 
+def create_formula():
+    r = call_api_get( "/api/formula" )
+    if r.status_code != 200: return r
+    while True:
+        time.sleep(1)
+        r = call_api_get( "/api/formula/status" )
+        if r.status_code != 200 or not json.loads(r.text)["status"]: return r
+
 def do_factory_reset():
     try:
         r = call_api_get( "/api/factory?id=" + id)
@@ -69,7 +85,11 @@ class API(unittest.TestCase):
         self.assertEqual(j["http_push2_h1"], "Content-Type: application/json")
         self.assertEqual(j["http_push2_h2"], "")
         self.assertEqual(j["http_push3"], "")
+        self.assertEqual(j["http_push_fingerprint"], "")
+        self.assertEqual(j["http_push2_fingerprint"], "")
+        self.assertEqual(j["http_push3_fingerprint"], "")
         self.assertEqual(j["influxdb2_push"], "")
+        self.assertEqual(j["influxdb2_fingerprint"], "")
         self.assertEqual(j["influxdb2_org"], "")
         self.assertEqual(j["influxdb2_bucket"], "")
         self.assertEqual(j["influxdb2_auth"], "")
@@ -106,6 +126,18 @@ class API(unittest.TestCase):
         self.assertEqual(j["tempsensor_resolution"], 9)
         self.assertEqual(j["ignore_low_angles"], False)
         self.assertEqual(j["battery_saving"], True)
+        self.assertEqual(j["push_deadband_gravity"], 0)
+        self.assertEqual(j["push_deadband_temp"], 0)
+        self.assertEqual(j["push_max_silence"], 3600)
+        self.assertEqual(j["sleep_adaptive"], False)
+        self.assertEqual(j["sleep_interval_min"], 300)
+        self.assertEqual(j["sleep_interval_max"], 3600)
+        self.assertEqual(j["gravity_filter"], False)
+        self.assertEqual(j["gyro_fusion"], False)
+        self.assertEqual(j["gyro_still_time"], 10)
+        self.assertEqual(j["gravity_lookup"], False)
+        self.assertEqual(j["gyro_scale_data"]["sx"], 1)
+        self.assertEqual(j["gyro_scale_data"]["ox"], 0)
         self.assertEqual(len(j["formula_calculation_data"]), 10)
         self.assertEqual(j["formula_calculation_data"][0]["a"], 0)
         self.assertEqual(j["formula_calculation_data"][0]["g"], 1.0)
@@ -688,6 +720,12 @@ class API(unittest.TestCase):
         j = json.loads(r.text)
         self.assertEqual(j["success"], True)
         self.assertNotEqual(j["message"], "")
+        job = j["job_id"]
+        r = call_api_post( "/api/test/push", { "push_format": "http_format" } )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["job_id"], job)
         r = call_api_get( "/api/test/push/status" )
         if debugResult: print(r.text)
         self.assertEqual(r.status_code, 200)
@@ -748,13 +786,159 @@ class API(unittest.TestCase):
         self.assertEqual(j["token"], id)
       
     def test_63_createformula(self):
-        r = call_api_get( "/api/formula" )
+        r = call_api_get( "/api/formula/status" )
+        self.assertEqual(r.status_code, 200)
+        r = create_formula()
         if debugResult: print(r.text)
         self.assertEqual(r.status_code, 200)
         j = json.loads(r.text)
         self.assertEqual(j["success"], True)
         self.assertNotEqual(j["message"], "")
         self.assertNotEqual(j["gravity_formula"], "")
+
+    def test_64_formula_data(self):
+        csv = "angle,gravity,temp\n25,1.0,20\n30,1.01,20\n35,1.02,20\n40,1.03,20\n45,1.04\n"
+        url = "http://" + host + "/api/formula/data"
+        r = requests.post( url, data=csv, headers={ "Authorization": "Bearer " + id, "Content-Type": "text/csv"} )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["success"], True)
+        self.assertEqual(j["calibration_points"], 5)
+
+        r = call_api_get( "/api/formula/data" )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        lines = r.text.splitlines()
+        self.assertEqual(lines[0], "angle,gravity,temp")
+        self.assertEqual(len(lines), 6)
+        self.assertEqual(lines[5], "45.000,1.0400,20.00")
+
+        r = create_formula()
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["success"], True)
+
+        # Data without a valid token is never stored
+        r = requests.post( url, data="angle,gravity,temp\n25,1.0,20\n", headers={ "Content-Type": "text/csv"} )
+        self.assertEqual(r.status_code, 401)
+        r = call_api_get( "/api/formula/data" )
+        self.assertEqual(len(r.text.splitlines()), 6)
+
+        # An import without valid points keeps the current points
+        r = requests.post( url, data="angle,gravity,temp\n", headers={ "Authorization": "Bearer " + id, "Content-Type": "text/csv"} )
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["success"], False)
+        self.assertEqual(j["calibration_points"], 0)
+        r = call_api_get( "/api/formula/data" )
+        self.assertEqual(len(r.text.splitlines()), 6)
+
+        r = call_api_delete( "/api/formula/data" )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["success"], True)
+        r = call_api_get( "/api/formula/data" )
+        self.assertEqual(len(r.text.splitlines()), 1)
+
+    def test_65_job(self):
+        r = call_api_get( "/api/hardware" )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["success"], True)
+        jobId = j["job_id"]
+        self.assertNotEqual(jobId, -1)
+
+        time.sleep(2)
+        r = call_api_get( "/api/job/" + str(jobId) )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["job_id"], jobId)
+        self.assertEqual(j["job_state"], "completed")
+        self.assertEqual(j["status"], False)
+        self.assertEqual(j["success"], True)
+        self.assertEqual(j["progress"], 100)
+        self.assertNotEqual(j["job_result"]["chip"], None)
+
+        r = call_api_get( "/api/job/9999" )
+        self.assertEqual(r.status_code, 404)
+
+    def test_66_testpush_all(self):
+        j = {"push_format": "all" }
+        r = call_api_post( "/api/push", j )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["success"], True)
+
+        time.sleep(10)
+        r = call_api_get( "/api/push/status" )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["status"], False)
+        for t in j["push_targets"]:
+            self.assertNotEqual(t["push_format"], "")
+            self.assertGreaterEqual(t["send_time"], 0)
+            self.assertGreaterEqual(t["send_time"], t["request_time"] + t["response_time"])
+
+    def test_67_metrics(self):
+        r = call_api_get( "/api/status" )
+        self.assertEqual(r.status_code, 200)
+        r = call_api_get( "/api/metrics" )
+        if debugResult: print(r.text)
+        self.assertEqual(r.status_code, 200)
+        self.assertTrue(r.headers["Content-Type"].startswith("text/plain"))
+        self.assertIn('gravitymon_http_requests_total{route="/api/status",method="GET"}', r.text)
+        self.assertIn("gravitymon_free_heap_bytes", r.text)
+
+    def test_68_assets(self):
+        r = requests.get( "http://" + host + "/" )
+        self.assertEqual(r.status_code, 200)
+        self.assertEqual(r.headers["Cache-Control"], "no-cache")
+        js = re.search(r'src="(/js/app\.[0-9a-f]{8}\.js)"', r.text).group(1)
+
+        url = "http://" + host + js
+        r = requests.get( url )
+        self.assertEqual(r.status_code, 200)
+        self.assertIn("immutable", r.headers["Cache-Control"])
+        etag = r.headers["ETag"]
+        self.assertNotEqual(etag, "")
+        r = requests.get( url, headers={ "If-None-Match": etag } )
+        self.assertEqual(r.status_code, 304)
+        self.assertEqual(r.headers["ETag"], etag)
+
+    def test_69_config_patch(self):
+        r = call_api_get( "/api/config" )
+        mdns = json.loads(r.text)["mdns"]
+        j = { "sleep_interval": 901 }
+        r = call_api_patch( "/api/config", j )
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["success"], True)
+        self.assertEqual(j["changed"], True)
+        r = call_api_patch( "/api/config", { "sleep_interval": 901 } )
+        self.assertEqual(r.status_code, 200)
+        j = json.loads(r.text)
+        self.assertEqual(j["changed"], False)
+        r = call_api_get( "/api/config" )
+        j = json.loads(r.text)
+        self.assertEqual(j["sleep_interval"], 901)
+        self.assertEqual(j["mdns"], mdns)
+        r = call_api_patch( "/api/config", { "sleep_interval": 900 } )
+        self.assertEqual(r.status_code, 200)
+
+    def test_70_config_fingerprint(self):
+        # Digits depend on the platform, invalid values leave the pin unchanged
+        for fp in [ "12:34", "zz:34", "12" * 41 ]:
+            r = call_api_patch( "/api/config", { "http_push_fingerprint": fp } )
+            self.assertEqual(r.status_code, 200)
+            r = call_api_get( "/api/config" )
+            j = json.loads(r.text)
+            self.assertEqual(j["http_push_fingerprint"], "")
                
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,68 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <AUnit.h>
+
+#include <arena.hpp>
+
+test(arena_allocAndRelease) {
+  Arena arena(64);
+
+  assertEqual(arena.size(), 64U);
+
+  void *a = arena.alloc(3);
+  size_t mark = arena.mark();
+  void *b = arena.alloc(8);
+
+  assertTrue(a != nullptr);
+  assertTrue(b != nullptr);
+  assertEqual(reinterpret_cast<uintptr_t>(b) % 4, 0U);
+  assertEqual(arena.used(), 12U);
+
+  arena.release(mark);
+  assertEqual(arena.used(), 3U);
+  assertTrue(arena.alloc(61) == nullptr);
+
+  arena.reset();
+  assertTrue(arena.alloc(64) != nullptr);
+  assertEqual(arena.peak(), 64U);
+}
+
+test(arena_reserve) {
+  Arena arena;
+
+  assertEqual(arena.size(), 0U);
+  assertTrue(arena.alloc(1) == nullptr);
+
+  assertTrue(arena.reserve(10));
+  assertEqual(arena.size(), 10U);
+  assertTrue(arena.alloc(10) != nullptr);
+  assertTrue(arena.alloc(1) == nullptr);
+
+  assertTrue(arena.reserve(0));
+  assertEqual(arena.size(), 0U);
+  assertEqual(arena.used(), 0U);
+  assertEqual(arena.peak(), 10U);
+}
+
+// EOF
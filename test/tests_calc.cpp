@@ -44,7 +44,12 @@ test(calc_createFormula2) {
   RawFormulaData fd = {
       {25.0, 30.0, 35.0, 40.0, 45.0, 50.0, 55.0, 60.0, 65.0, 70.0},
       {1.0, 1.01, 1.02, 1.03, 1.04, 1.05, 1.06, 1.07, 1.08, 1.1}};
+  float f = myConfig.getMaxFormulaCreationDeviation();
+  // Validation covers all points, not only the first five as before, and the
+  // points at 65 and 70 deviate 3.8 mSG from this order 2 formula.
+  myConfig.setMaxFormulaCreationDeviation(4);
   int i = createFormula(fd, &buffer[0], sizeof(buffer), 2);
+  myConfig.setMaxFormulaCreationDeviation(f);
   assertEqual(i, 0);
   assertEqual(&buffer[0], "0.00000909*tilt^2+0.00124545*tilt+0.96445455");
 }
@@ -91,6 +96,67 @@ test(calc_createFormula6) {
   assertEqual(i, -3);
 }
 
+test(calc_createFormulaAuto1) {
+  char buffer[100];
+  RawFormulaData fd = {
+      {25.0, 30.0, 35.0, 40.0, 45.0, 50.0, 55.0, 60.0, 65.0, 70.0},
+      {1.0, 1.01, 1.02, 1.03, 1.04, 1.05, 1.06, 1.07, 1.08, 1.1}};
+  int i = createFormula(fd, &buffer[0], sizeof(buffer));
+  assertEqual(i, 0);
+  assertEqual(&buffer[0], "0.00000065*tilt^3+-0.00008392*tilt^2+0.00542424*tilt+0.90586014");
+}
+
+test(calc_createFormulaAuto2) {
+  char buffer[100];
+  RawFormulaData fd = {
+      {25.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+      {1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0}};
+  int i = createFormula(fd, &buffer[0], sizeof(buffer));
+  assertEqual(i, ERR_FORMULA_NOTENOUGHVALUES);
+}
+
+test(calc_createFormulaTruncated) {
+  char buffer[60];  // The order 3 formula needs 67 characters
+  RawFormulaData fd = {
+      {25.0, 30.0, 35.0, 40.0, 45.0, 50.0, 55.0, 60.0, 65.0, 70.0},
+      {1.0, 1.01, 1.02, 1.03, 1.04, 1.05, 1.06, 1.07, 1.08, 1.1}};
+  int i = createFormula(fd, &buffer[0], sizeof(buffer));
+  assertEqual(i, ERR_FORMULA_INTERNAL);
+  assertEqual(&buffer[0], "");
+}
+
+test(calc_createFormulaSurface) {
+  char buffer[100];
+  FormulaDataSource source = [](const FormulaPointCallback &callback) {
+    for (int t = 10; t <= 26; t += 8) {
+      for (int a = 25; a <= 70; a += 15) {
+        callback(a, 0.871 + 0.00112 * a + 0.0000061 * a * a +
+                        0.0004 * (t - 20) + 0.00001 * a * (t - 20),
+                 t);
+      }
+    }
+  };
+  int i = createFormula(source, &buffer[0], sizeof(buffer), 1,
+                        FORMULA_MAX_ORDER);
+  assertEqual(i, 0);
+  assertEqual(&buffer[0], "0.00000610*tilt^2+0.00092000*tilt+0.86300000+0.00040000*temp+0.00001000*tilt*temp");
+}
+
+test(calc_compileFormula) {
+  FormulaKernel kernel;
+  assertTrue(compileFormula("0.00001140*tilt^3+-0.00161278*tilt^2+0.08512845*tilt+-0.30122180", kernel));
+  assertNear(evaluateFormula(kernel, 30, 20), 1.1089, 0.0001);
+  assertTrue(compileFormula("0.02*tilt+0.5+0.001*temp-0.0001*tilt*temp", kernel));
+  assertNear(evaluateFormula(kernel, 30, 10), 1.08, 0.0001);
+  assertFalse(compileFormula("0.00000909*tilt2^2+0.00124545*tilt", kernel));
+  assertFalse(compileFormula("(tilt+1)*0.5", kernel));
+  assertFalse(compileFormula("0.1*tilt^-1", kernel));
+  assertFalse(compileFormula("0.1*tilt^-1*temp", kernel));
+  assertFalse(compileFormula("0.1*tilt^+0.5", kernel));
+  assertFalse(compileFormula("0.1*tilt^", kernel));
+  assertFalse(compileFormula("0.1*tilt^*temp", kernel));
+}
+
 /*test(calc_createFormula7) { // TODO: Find data that will cause INTERNAL_ERROR in the fitCurve library...
   char buffer[100];
   RawFormulaData fd = {
@@ -115,6 +181,25 @@ test(calc_calculateGravity2) {
   assertEqual(g, g2);
 }
 
+test(calc_calculateGravityRate) {
+  float g[] = {1.050, 1.048, 1.046, 1.044};
+  uint32_t t[] = {0, 3600, 7200, 10800};
+  double r = calculateGravityRate(&g[0], &t[0], 4);
+  assertNear(r, -0.002, 0.00001);
+  assertEqual(calculateGravityRate(&g[0], &t[0], 1), 0.0);
+}
+
+test(calc_applyKalmanFilter) {
+  FilterState state = {0, 0};
+  float f = applyKalmanFilter(state, 1.050, 0.0001, 0.0004, 0.01);
+  assertNear(f, 1.050, 0.00001);
+  f = applyKalmanFilter(state, 1.052, 0.0001, 0.0004, 0.01);
+  assertMore(f, 1.050);
+  assertLess(f, 1.052);
+  f = applyKalmanFilter(state, 1.020, 0.0001, 0.0004, 0.01);  // Reset
+  assertNear(f, 1.020, 0.00001);
+}
+
 test(calc_gravityTemperatureCorrectionC) {
   double g = gravityTemperatureCorrectionC(1.02, 45.0, 20.0);
   float v1 = reduceFloatPrecision(g, 2);
@@ -24,6 +24,7 @@ SOFTWARE.
 #include <AUnit.h>
 
 #include <config.hpp>
+#include <resources.hpp>
 
 GravmonConfig myConfig("test", "test.cfg");
 
@@ -52,6 +53,22 @@ test(config_advDefaultValues) {
   assertEqual(myConfig.getWifiConnectionTimeout(), 20);
   assertEqual(myConfig.getWifiPortalTimeout(), 120);
   assertEqual(myConfig.isIgnoreLowAnges(), false);
+  assertEqual(myConfig.getPushDeadbandGravity(), 0.0);
+  assertEqual(myConfig.getPushDeadbandTemp(), 0.0);
+  assertEqual(myConfig.getPushMaxSilence(), 3600);
+  assertEqual(myConfig.isPushDeadbandActive(), false);
+  assertEqual(myConfig.isSleepAdaptive(), false);
+  assertEqual(myConfig.getSleepIntervalMin(), 300);
+  assertEqual(myConfig.getSleepIntervalMax(), 3600);
+  assertEqual(myConfig.isGravityFilter(), false);
+  assertEqual(myConfig.isGyroFusion(), false);
+  assertEqual(myConfig.getGyroStillTime(), 10);
+  assertEqual(myConfig.isGravityLookup(), false);
+  assertEqual(myConfig.hasAccelScale(), false);
+  assertEqual(myConfig.getHttpPostFingerprint(), "");
+  assertEqual(myConfig.getHttpPost2Fingerprint(), "");
+  assertEqual(myConfig.getHttpGetFingerprint(), "");
+  assertEqual(myConfig.getInfluxDb2Fingerprint(), "");
 }
 
 test(config_tempFormat) {
@@ -72,4 +89,47 @@ test(config_gravityFormat) {
   assertEqual(myConfig.getGravityFormat(), 'G');
 }
 
+test(config_stringCapacity) {
+  GravmonConfig cfg("test", "test2.cfg");
+  char buf[300];
+
+  memset(buf, 'x', sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = 0;
+  cfg.setToken("token");
+  cfg.setGravityFormula(buf);
+  assertEqual(cfg.getToken(), "token");
+  assertEqual(cfg.getToken2(), "");
+  assertEqual(strlen(cfg.getGravityFormula()),
+              configStringCapacity(CFG_STR_GRAVITY_FORMULA));
+}
+
+test(config_parseJson) {
+  GravmonConfig cfg("test", "test2.cfg");
+  DynamicJsonDocument doc(JSON_BUFFER_SIZE_L);
+  JsonObject obj = doc.to<JsonObject>();
+
+  obj[PARAM_SLEEP_INTERVAL] = 300;
+  obj[PARAM_GRAVITY_FORMAT] = "P";
+  obj[PARAM_TEMPSENSOR_RESOLUTION] = 13;  // Out of range, ignored
+  obj[PARAM_GYRO_FUSION] = true;
+  obj[PARAM_GYRO_CALIBRATION]["ax"] = 100;
+  obj[PARAM_SLEEP_INTERVAL_MIN] = 0;  // Out of range, ignored
+  cfg.parseJson(obj);
+
+  assertEqual(cfg.getSleepInterval(), 300);
+  assertEqual(cfg.getGravityFormat(), 'P');
+  assertEqual(cfg.getTempSensorResolution(), 9);
+  assertEqual(cfg.getSleepIntervalMin(), 300);
+  assertEqual(cfg.isGyroFusion(), true);
+  assertEqual(cfg.getGyroCalibration().ax, 100);
+  assertEqual(cfg.getGyroCalibration().ay, 0);
+
+  doc.clear();
+  obj = doc.to<JsonObject>();
+  cfg.createJson(obj);
+  assertEqual(obj[PARAM_SLEEP_INTERVAL].as<int>(), 300);
+  assertEqual(obj[PARAM_GRAVITY_FORMAT].as<String>(), String("P"));
+  assertEqual(obj[PARAM_GYRO_CALIBRATION]["ax"].as<int>(), 100);
+}
+
 // EOF
@@ -0,0 +1,86 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <AUnit.h>
+
+#include <calc.hpp>
+#include <fixedpoint.hpp>
+
+// Error bounds are verified against the float reference, the fixed point path
+// is enabled with -D ENABLE_FIXED_POINT.
+
+test(fixedpoint_arithmetic) {
+  Fixed<16> a = Fixed<16>::fromDouble(2.5), b = Fixed<16>::fromDouble(-1.25);
+  assertNear((a + b).toDouble(), 1.25, 0.00001);
+  assertNear((a - b).toDouble(), 3.75, 0.00001);
+  assertNear((a * b).toDouble(), -3.125, 0.00001);
+  assertNear((a / b).toDouble(), -2.0, 0.00001);
+  assertNear(a.convert<24>().toDouble(), 2.5, 0.00001);
+}
+
+test(fixedpoint_sqrt) {
+  for (int i = 1; i < 1000; i++) {
+    double x = i * 0.1;
+    assertNear(fixedSqrt(Fixed<16>::fromDouble(x)).toDouble(), sqrt(x),
+               0.00002);
+  }
+}
+
+test(fixedpoint_acos) {
+  for (int i = 0; i <= 1000; i++) {
+    double x = i / 1000.0;
+    assertNear(fixedAcos(Fixed<28>::fromDouble(x)).toDouble(), acos(x),
+               0.0000002);
+  }
+}
+
+#if defined(ENABLE_FIXED_POINT)
+test(fixedpoint_formula) {
+  FormulaKernel kernel;
+  FixedFormulaKernel fixed;
+
+  assertTrue(compileFormula(
+      "0.00001140*tilt^3+-0.00161278*tilt^2+0.08512845*tilt+-0.30122180",
+      kernel));
+  assertTrue(compileFixedFormula(kernel, fixed));
+
+  for (int a = 20; a <= 85; a++) {
+    assertNear(evaluateFixedFormula(fixed, a, 20),
+               evaluateFormula(kernel, a, 20), 0.0000005);
+  }
+
+  // Coefficients that are out of range for the Q format uses float
+  assertTrue(compileFormula("0.00000200*tilt^4+-0.00030333*tilt^3+0.01645000*"
+                            "tilt^2+-0.36241667*tilt+3.73750001",
+                            kernel));
+  assertFalse(compileFixedFormula(kernel, fixed));
+}
+
+test(fixedpoint_temperatureCorrection) {
+  // Reference values from the float implementation
+  assertNear(gravityTemperatureCorrectionC(1.05, 30, 20), 1.052604, 0.000001);
+  assertNear(gravityTemperatureCorrectionC(1.05, 10, 20), 1.048460, 0.000001);
+}
+#endif
+
+// EOF
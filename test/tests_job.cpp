@@ -0,0 +1,150 @@
+/*
+MIT License
+
+Copyright (c) 2024 Magnus
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+#include <AUnit.h>
+
+#include <job.hpp>
+
+test(job_runToCompletion) {
+  JobScheduler jobs;
+  int steps = 0;
+
+  int id = jobs.submit("test", [&steps](Job &job) {
+    job.progress = ++steps * 10;
+    job.success = true;
+    return steps == 10;
+  });
+
+  assertNotEqual(id, JOB_INVALID_ID);
+  assertTrue(jobs.isActive(id));
+
+  for (int i = 0; i < 5 && jobs.isActive(id); i++) jobs.loop();
+
+  assertFalse(jobs.isActive(id));
+  assertEqual(steps, 10);
+  assertTrue(jobs.find(id)->state == JobState::completed);
+  assertEqual(jobs.find(id)->progress, 100);
+}
+
+test(job_timeSlice) {
+  JobScheduler jobs;
+  int steps = 0;
+
+  int id = jobs.submit("slow", [&steps](Job &job) {
+    delay(JOB_TIME_SLICE / 2);
+    return ++steps == 10;
+  });
+
+  jobs.loop();  // Slice ends before all steps are done
+  assertTrue(jobs.isActive(id));
+  assertLess(steps, 10);
+
+  while (jobs.isActive(id)) jobs.loop();
+  assertTrue(jobs.find(id)->state == JobState::failed);  // success not set
+}
+
+test(job_cancel) {
+  JobScheduler jobs;
+  bool cleanup = false;
+
+  int id = jobs.submit("cancel", [&cleanup](Job &job) {
+    if (job.cancelled) cleanup = true;
+    return false;
+  });
+  int queued = jobs.submit("queued", [](Job &job) { return true; });
+
+  jobs.loop();
+  assertTrue(jobs.cancel(id));
+  assertTrue(jobs.cancel(queued));
+  jobs.loop();
+
+  assertTrue(cleanup);
+  assertTrue(jobs.find(id)->state == JobState::cancelled);
+  assertTrue(jobs.find(queued)->state == JobState::cancelled);
+  assertFalse(jobs.cancel(id));
+}
+
+test(job_cancelAfterDone) {
+  JobScheduler jobs;
+  int id = 0;
+
+  // The cancel arrives in the slice where the job completes
+  id = jobs.submit("done", [&jobs, &id](Job &job) {
+    jobs.cancel(id);
+    job.success = true;
+    return true;
+  });
+
+  jobs.loop();
+  assertTrue(jobs.find(id)->state == JobState::completed);
+}
+
+test(job_status) {
+  JobScheduler jobs;
+  JobStatus status;
+  int steps = 0;
+
+  int id = jobs.submit("status", [&steps](Job &job) {
+    job.progress = 50;
+    job.success = true;
+    job.result = "{}";
+    delay(JOB_TIME_SLICE);
+    return ++steps == 2;
+  });
+
+  jobs.loop();  // Result is not published while running
+  assertTrue(jobs.getStatus(id, status));
+  assertTrue(status.state == JobState::running);
+  assertEqual(status.progress, 50);
+  assertEqual(status.result.length(), 0U);
+
+  jobs.loop();
+  assertTrue(jobs.getStatus(id, status));
+  assertTrue(status.state == JobState::completed);
+  assertEqual(status.progress, 100);
+  assertEqual(status.result, "{}");
+  assertFalse(jobs.getStatus(id + 1, status));
+}
+
+test(job_queueFull) {
+  JobScheduler jobs;
+  int id[JOB_QUEUE_SIZE];
+
+  for (int i = 0; i < JOB_QUEUE_SIZE; i++)
+    id[i] = jobs.submit("fill", [](Job &job) {
+      job.success = true;
+      job.result = "{}";
+      return true;
+    });
+
+  assertEqual(jobs.submit("full", [](Job &job) { return true; }),
+              JOB_INVALID_ID);
+
+  jobs.loop();  // Oldest job finished, its slot can be reused
+  int reuse = jobs.submit("reuse", [](Job &job) { return true; });
+  assertNotEqual(reuse, JOB_INVALID_ID);
+  assertTrue(jobs.find(id[0]) == nullptr);
+  assertTrue(jobs.find(id[1]) != nullptr);
+}
+
+// EOF
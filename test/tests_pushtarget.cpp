@@ -25,8 +25,28 @@ SOFTWARE.
 #include <Arduino.h>
 
 #include <main.hpp>
+#include <pushtarget.hpp>
 
 // TODO: Build some php scripts that run on gravitymon.com for testing the push
 // data.
 
+test(push_parseTarget) {
+  String host;
+  uint16_t port;
+
+  assertTrue(parsePushTarget("http://192.168.1.2:8080/api", host, port));
+  assertEqual(host, "192.168.1.2");
+  assertEqual(port, 8080);
+  assertTrue(parsePushTarget("https://www.example.com/api", host, port));
+  assertEqual(host, "www.example.com");
+  assertEqual(port, 443);
+  assertTrue(parsePushTarget("http://www.example.com", host, port));
+  assertEqual(host, "www.example.com");
+  assertEqual(port, 80);
+  assertTrue(parsePushTarget("mqtt.local", host, port));
+  assertEqual(host, "mqtt.local");
+  assertEqual(port, 1883);
+  assertFalse(parsePushTarget("", host, port));
+}
+
 // EOF
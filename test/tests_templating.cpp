@@ -160,4 +160,19 @@ test(template_applyTemplate7) {
   assertEqual(s, v);
 }
 
+test(template_applyTemplate8) {
+  TemplatingEngine e;
+  GravmonPush p(&cfg);
+  myConfig.setMDNS("gravitymon");
+
+  const char* tpl =
+    "${gravity}-${gravity-raw}-${gravity-filtered}-${temp-raw}-${temp-filtered}";
+
+  p.setupTemplateEngine(e, 45.0, 1.123, 1.223, 21.2, 2.98, 3.88, 1.125, 21.4);
+  String s = e.create(tpl);
+
+  String v = "1.1230-1.1250-1.1230-21.40-21.20";
+  assertEqual(s, v);
+}
+
 // EOF